@@ -11,213 +11,2577 @@
 #include "HMAC_SHA1.h"
 #include "Base64.h"
 #include "AmazonS3.h"
+#include "ParallelGZIPOutputStream.h"
+#include "TransferBufferPool.h"
+#include "WorkQueue.h"
 
 
 //==============================================================================
+//==============================================================================
+namespace
+{
+    // Header names and result text repeat across millions of objects, so
+    // they're shared rather than held per object
+    StringPool& getHeaderPool()
+    {
+        static StringPool pool;
+        return pool;
+    }
+    
+    // The usual reason phrases are pooled once, up front, so most responses
+    // (and every empty S3ObjectInfo) never need the pool's lock
+    class StandardReasons
+    {
+    public:
+        StandardReasons()
+            : invalidResponse (getHeaderPool().getPooledString ("Invalid Response"))
+        {
+            for (int i = 0; i < numElementsInArray (phrases); ++i)
+                pooled.add (getHeaderPool().getPooledString (phrases[i]));
+        }
+        
+        // Null if it's not one of them
+        String::CharPointerType find (const char* text, const char* end) const
+        {
+            const size_t length = (size_t) (end - text);
+            
+            for (int i = 0; i < numElementsInArray (phrases); ++i)
+                if (strlen (phrases[i]) == length && memcmp (phrases[i], text, length) == 0)
+                    return pooled.getUnchecked (i);
+            
+            return String::CharPointerType (nullptr);
+        }
+        
+        const String::CharPointerType invalidResponse;
+        
+    private:
+        static const char* const phrases[22];
+        Array<String::CharPointerType> pooled;
+    };
+    
+    const char* const StandardReasons::phrases[] =
+    {
+        "OK", "Created", "Accepted", "No Content", "Partial Content",
+        "Continue", "Moved Permanently", "Found", "Not Modified", "Temporary Redirect",
+        "Bad Request", "Forbidden", "Not Found", "Method Not Allowed", "Conflict",
+        "Length Required", "Precondition Failed", "Requested Range Not Satisfiable",
+        "Internal Server Error", "Not Implemented", "Service Unavailable", "Connection established"
+    };
+    
+    const StandardReasons standardReasons;
+    
+    bool matchesIgnoreCase (const char* text, const char* end, const char* name)
+    {
+        while (text < end && *name != 0)
+        {
+            if (CharacterFunctions::toLowerCase ((juce_wchar) (uint8) *text) != (juce_wchar) (uint8) *name)
+                return false;
+            
+            ++text;
+            ++name;
+        }
+        
+        return text == end && *name == 0;
+    }
+    
+    bool startsWithIgnoreCase (const char* text, const char* end, const char* prefix)
+    {
+        const size_t len = strlen (prefix);
+        return (size_t) (end - text) >= len && matchesIgnoreCase (text, text + len, prefix);
+    }
+    
+    int hexValue (juce_wchar c)
+    {
+        if (c >= '0' && c <= '9')   return c - '0';
+        if (c >= 'a' && c <= 'f')   return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')   return c - 'A' + 10;
+        
+        return -1;
+    }
+    
+    int monthFromName (const String& name)
+    {
+        static const char* const months[] = { "jan", "feb", "mar", "apr", "may", "jun",
+                                              "jul", "aug", "sep", "oct", "nov", "dec" };
+        
+        for (int m = 0; m < 12; ++m)
+            if (name.startsWithIgnoreCase (months[m]))
+                return m + 1;
+        
+        return 0;
+    }
+    
+    int64 toMillisecondsUTC (int year, int month, int day, int hours, int minutes, double seconds)
+    {
+        if (month < 1 || month > 12 || day < 1 || day > 31)
+            return 0;
+        
+        // Days since 1970 for a proleptic Gregorian date, avoids mktime's time zones
+        const int y = year - (month <= 2 ? 1 : 0);
+        const int era = (y >= 0 ? y : y - 399) / 400;
+        const int yearOfEra = y - era * 400;
+        const int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        const int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        const int64 days = (int64) era * 146097 + dayOfEra - 719468;
+        
+        return ((days * 24 + hours) * 60 + minutes) * 60000 + (int64) (seconds * 1000.0 + 0.5);
+    }
+    
+    // S3's limits for multipart uploads, bar the last part
+    const int minPartSize = 5 * 1024 * 1024;
+    const int maxParts = 10000;
+    const int64 maxSingleCopySize = (int64) 5 * 1024 * 1024 * 1024;
+    const int defaultCopyPartSize = 256 * 1024 * 1024;
+    
+    //==============================================================================
+    class KeyCollector  : public ListBucketParser::Listener
+    {
+    public:
+        KeyCollector (StringArray& keys_) : keys (keys_) {}
+        
+        void listEntry (const ListBucketParser::Entry& entry)   { keys.add (entry.key); }
+        
+    private:
+        StringArray& keys;
+        
+        JUCE_DECLARE_NON_COPYABLE (KeyCollector);
+    };
+    
+    // Listings come back in key order, which is what KeyTable wants
+    class KeyTableCollector  : public ListBucketParser::Listener
+    {
+    public:
+        KeyTableCollector (KeyTable& table_) : table (table_), outOfOrder (false) {}
+        
+        void listEntry (const ListBucketParser::Entry& entry)
+        {
+            if (! table.add (entry.key))
+                outOfOrder = true;
+        }
+        
+        bool failed() const     { return outOfOrder; }
+        
+    private:
+        KeyTable& table;
+        bool outOfOrder;
+        
+        JUCE_DECLARE_NON_COPYABLE (KeyTableCollector);
+    };
+    
+    class ObjectTableCollector  : public ListBucketParser::Listener
+    {
+    public:
+        ObjectTableCollector (ObjectTable& table_) : table (table_), outOfOrder (false) {}
+        
+        void listEntry (const ListBucketParser::Entry& entry)
+        {
+            if (! table.add (entry))
+                outOfOrder = true;
+        }
+        
+        bool failed() const     { return outOfOrder; }
+        
+    private:
+        ObjectTable& table;
+        bool outOfOrder;
+        
+        JUCE_DECLARE_NON_COPYABLE (ObjectTableCollector);
+    };
+    
+    class BloomFilterCollector  : public ListBucketParser::Listener
+    {
+    public:
+        BloomFilterCollector (BloomFilter& filter_) : filter (filter_) {}
+        
+        void listEntry (const ListBucketParser::Entry& entry)   { filter.add (entry.key); }
+        
+    private:
+        BloomFilter& filter;
+        
+        JUCE_DECLARE_NON_COPYABLE (BloomFilterCollector);
+    };
+    
+    //==============================================================================
+    bool isGzipEncoded (const S3ObjectInfo& info)
+    {
+        return info.getHeader ("Content-Encoding").equalsIgnoreCase ("gzip");
+    }
+    
+    // Passes writes on and keeps the checksum of everything that went by,
+    // in the form S3 reports it
+    class ChecksummingOutputStream  : public OutputStream
+    {
+    public:
+        ChecksummingOutputStream (OutputStream& dest_, Checksum::Type type_)
+            : dest (dest_), type (type_) {}
+        
+        bool write (const void* data, int numBytes)
+        {
+            if (type == Checksum::md5)              md5.update (data, (size_t) numBytes);
+            else if (type == Checksum::crc32c)      crc32.update (data, (size_t) numBytes);
+            else                                    crc64.update (data, (size_t) numBytes);
+            
+            return dest.write (data, numBytes);
+        }
+        
+        void flush()                { dest.flush(); }
+        bool setPosition (int64)    { return false; }
+        int64 getPosition()         { return dest.getPosition(); }
+        
+        String getChecksum() const
+        {
+            if (type == Checksum::md5)      return md5.toHexString();
+            if (type == Checksum::crc32c)   return crc32.toBase64();
+            
+            return crc64.toBase64();
+        }
+        
+    private:
+        OutputStream& dest;
+        const Checksum::Type type;
+        ResumableMD5 md5;
+        CRC32C crc32;
+        CRC64NVME crc64;
+        
+        JUCE_DECLARE_NON_COPYABLE (ChecksummingOutputStream);
+    };
+    
+    // Like OutputStream::writeFromInputStream, but through a pooled
+    // buffer a megabyte at a time rather than 8K on the stack, and counting
+    // past 2GB.  A numBytes of -1 copies to the end.
+    int64 copyStream (InputStream& source, OutputStream& dest, int64 numBytes)
+    {
+        TransferBuffer buffer (1024 * 1024);
+        int64 numCopied = 0;
+        
+        while (numBytes < 0 || numCopied < numBytes)
+        {
+            const int64 wanted = numBytes < 0 ? (int64) buffer.getSize()
+                                              : jmin ((int64) buffer.getSize(), numBytes - numCopied);
+            const int numRead = source.read (buffer, (int) wanted);
+            
+            if (numRead <= 0 || ! dest.write (buffer, numRead))
+                break;
+            
+            numCopied += numRead;
+        }
+        
+        return numCopied;
+    }
+    
+    // Compresses a file with a gzip header, as Content-Encoding: gzip wants,
+    // on all the cores, returning the checksum of the compressed bytes
+    String gzipFile (const File& source, const File& target, Checksum::Type type)
+    {
+        FileInputStream in (source);
+        FileOutputStream out (target);
+        
+        if (in.failedToOpen() || out.failedToOpen())
+            return String::empty;
+        
+        ChecksummingOutputStream checksummed (out, type);
+        
+        {
+            ParallelGZIPOutputStream gzip (&checksummed);
+            
+            if (copyStream (in, gzip, -1) != source.getSize())
+                return String::empty;
+            
+            gzip.flush();
+        }
+        
+        out.flush();
+        return out.getStatus().wasOk() ? checksummed.getChecksum() : String::empty;
+    }
+    
+    // JUCE's decompressor only reads zlib streams, so the gzip header is
+    // skipped here and the deflate data inside it read raw.  The CRC and
+    // length in the trailer catch anything damaged or cut short.
+    bool gunzip (InputStream& source, OutputStream& dest)
+    {
+        const int64 start = source.getPosition();
+        const int64 total = source.getTotalLength();
+        
+        uint8 header[10];
+        
+        if (total - start < 18 || source.read (header, 10) != 10
+             || header[0] != 0x1f || header[1] != 0x8b || header[2] != 8)
+            return false;
+        
+        if ((header[3] & 4) != 0)
+            source.skipNextBytes ((uint16) source.readShort());
+        
+        if ((header[3] & 8) != 0)
+            while (source.readByte() != 0 && ! source.isExhausted()) {}
+        
+        if ((header[3] & 16) != 0)
+            while (source.readByte() != 0 && ! source.isExhausted()) {}
+        
+        if ((header[3] & 2) != 0)
+            source.skipNextBytes (2);
+        
+        const int64 bodyStart = source.getPosition();
+        
+        if (! source.setPosition (total - 8))
+            return false;
+        
+        const uint32 expectedCRC = (uint32) source.readInt();
+        const uint32 expectedSize = (uint32) source.readInt();
+        source.setPosition (bodyStart);
+        
+        GZIPDecompressorInputStream inflater (&source, false, true);
+        TransferBuffer buffer (1024 * 1024);
+        uint32 crc = 0;
+        int64 numOut = 0;
+        
+        for (;;)
+        {
+            const int numRead = inflater.read (buffer, (int) buffer.getSize());
+            
+            if (numRead <= 0)
+                break;
+            
+            if (! dest.write (buffer, numRead))
+                return false;
+            
+            crc = ParallelGZIPOutputStream::updateCRC (crc, buffer, (size_t) numRead);
+            numOut += numRead;
+        }
+        
+        return crc == expectedCRC && (uint32) numOut == expectedSize;
+    }
+    
+    // Unzips a downloaded file in place, or into another
+    bool gunzipFile (const File& source, const File& target)
+    {
+        TemporaryFile temp (target);
+        
+        {
+            FileInputStream in (source);
+            FileOutputStream out (temp.getFile());
+            
+            if (in.failedToOpen() || out.failedToOpen() || ! gunzip (in, out))
+                return false;
+            
+            out.flush();
+        }
+        
+        return temp.overwriteTargetFileWithTemporary();
+    }
+    
+    //==============================================================================
+    String escapeXml (const String& text)
+    {
+        return text.replace ("&", "&amp;").replace ("<", "&lt;").replace (">", "&gt;")
+                   .replace ("\"", "&quot;").replace ("'", "&apos;");
+    }
+    
+    //==============================================================================
+    // What S3's COPY directive keeps of an object, taken from a HEAD so a
+    // copy made in parts gets it too: the content headers as curl
+    // arguments, with the x-amz-meta-* ones also as they're signed, sorted
+    // by name
+    void getCopiedHeaders (const S3ObjectInfo& info, String& contentType,
+                           String& headers, String& amzHeader)
+    {
+        StringArray names (info.getHeaderNames());
+        names.sort (false);
+        
+        for (int n = 0; n < names.size(); ++n)
+        {
+            const String& name = names[n];
+            const String value (info.getHeader (name));
+            
+            if (! (name == "content-type" || name == "content-encoding"
+                    || name == "content-disposition" || name == "content-language"
+                    || name == "cache-control" || name == "expires"
+                    || name.startsWith ("x-amz-meta-")))
+                continue;
+            
+            if (name == "content-type")
+                contentType = value;
+            
+            headers << "--header '" << name << ":" << value.replace ("'", "'\\''") << "' ";
+            
+            if (name.startsWith ("x-amz-"))
+                amzHeader << name << ":" << value << "\n";
+        }
+    }
+    
+    //==============================================================================
+    // What a 200 for the cached copy would have said
+    S3ObjectInfo getCachedInfo (const String& etag, const File& body)
+    {
+        return S3ObjectInfo ("HTTP/1.1 200 OK\r\nContent-Length: " + String (body.getSize())
+                              + "\r\nETag: \"" + etag + "\"\r\n");
+    }
+    
+    // Straight from the mapping to the file, OutputStream takes ints so big
+    // objects go in pieces
+    bool writeMappedFile (const MemoryMappedFile& mapped, const File& file)
+    {
+        file.getParentDirectory().createDirectory();
+        file.deleteFile();
+        
+        FileOutputStream out (file);
+        
+        if (out.failedToOpen())
+            return false;
+        
+        const char* data = static_cast <const char*> (mapped.getData());
+        size_t remaining = mapped.getSize();
+        
+        while (remaining > 0)
+        {
+            const int numBytes = (int) jmin (remaining, (size_t) (1 << 30));
+            
+            if (! out.write (data, numBytes))
+                return false;
+            
+            data += numBytes;
+            remaining -= (size_t) numBytes;
+        }
+        
+        out.flush();
+        return true;
+    }
+    
+    //==============================================================================
+    // Where a resumable download notes how far it got
+    File getResumeFile (const File& file)
+    {
+        return file.getSiblingFile (file.getFileName() + ".resume");
+    }
+    
+    // The ETag and the MD5 state, whose byte count is how much of the file
+    // is good
+    bool saveResumeState (const File& resumeFile, const String& etag, const ResumableMD5& md5)
+    {
+        const MemoryBlock state (md5.getState());
+        
+        String text;
+        text << "S3 resume 1\n"
+             << "etag\t" << etag << '\n'
+             << "md5\t" << String::toHexString (state.getData(), (int) state.getSize(), 0) << '\n';
+        
+        TemporaryFile temp (resumeFile);
+        
+        return temp.getFile().replaceWithText (text)
+                && temp.overwriteTargetFileWithTemporary();
+    }
+    
+    // How much of the file can be kept, 0 if it was for another version
+    int64 loadResumeState (const File& resumeFile, const String& etag, ResumableMD5& md5)
+    {
+        StringArray lines;
+        lines.addLines (resumeFile.loadFileAsString());
+        
+        MemoryBlock state;
+        state.loadFromHexString (lines [2].fromFirstOccurrenceOf ("\t", false, false));
+        
+        if (lines [0] != "S3 resume 1" || lines [1] != "etag\t" + etag || ! md5.setState (state))
+        {
+            md5.reset();
+            return 0;
+        }
+        
+        return md5.getNumBytes();
+    }
+    
+    //==============================================================================
+    // Takes curl's output with --dump-header -, the header blocks come first
+    // and the last one says what the body is.  A 206 (or a 200 when nothing
+    // was asked to be skipped) goes on the end of the file and through the
+    // MD5, anything else is an error document and is dropped.
+    class ResumeWriter  : public OutputStream
+    {
+    public:
+        ResumeWriter (FileOutputStream& out_, ResumableMD5& md5_,
+                      const File& resumeFile_, const String& etag_)
+            : out (out_), md5 (md5_), resumeFile (resumeFile_), etag (etag_),
+              inBody (false), keepBody (false), sinceSaved (0)
+        {
+        }
+        
+        bool write (const void* data, int numBytes)
+        {
+            const char* p = static_cast <const char*> (data);
+            
+            while (numBytes > 0 && ! inBody)
+            {
+                // Headers are only ever a few hundred bytes
+                header.append (p, 1);
+                ++p;
+                --numBytes;
+                
+                const char* text = static_cast <const char*> (header.getData());
+                const size_t size = header.getSize();
+                
+                if (size > 65536)
+                    return false;
+                
+                if (size >= 4 && memcmp (text + size - 4, "\r\n\r\n", 4) == 0)
+                {
+                    info = S3ObjectInfo (String::fromUTF8 (text, (int) size));
+                    header.setSize (0);
+                    
+                    // 100 Continue and redirects are followed by another block
+                    if (info.getStatus() >= 200 && (info.getStatus() < 300 || info.getStatus() >= 400))
+                        startBody();
+                }
+            }
+            
+            if (numBytes > 0 && keepBody)
+            {
+                if (! out.write (p, numBytes))
+                    return false;
+                
+                md5.update (p, (size_t) numBytes);
+                sinceSaved += numBytes;
+                
+                if (sinceSaved >= checkpointInterval)
+                    checkpoint();
+            }
+            
+            return true;
+        }
+        
+        void flush()                { out.flush(); }
+        bool setPosition (int64)    { return false; }
+        int64 getPosition()         { return md5.getNumBytes(); }
+        
+        const S3ObjectInfo& getInfo() const     { return info; }
+        
+        void checkpoint()
+        {
+            out.flush();
+            saveResumeState (resumeFile, etag, md5);
+            sinceSaved = 0;
+        }
+        
+    private:
+        FileOutputStream& out;
+        ResumableMD5& md5;
+        const File resumeFile;
+        const String etag;
+        
+        MemoryBlock header;
+        S3ObjectInfo info;
+        bool inBody, keepBody;
+        int64 sinceSaved;
+        
+        enum { checkpointInterval = 8 * 1024 * 1024 };
+        
+        void startBody()
+        {
+            inBody = true;
+            
+            if (info.getStatus() == 200 && md5.getNumBytes() > 0)
+            {
+                // The range was ignored, this is the whole object
+                out.setPosition (0);
+                out.truncate();
+                md5.reset();
+            }
+            
+            keepBody = info.getStatus() == 200 || info.getStatus() == 206;
+        }
+        
+        JUCE_DECLARE_NON_COPYABLE (ResumeWriter);
+    };
+    
+    //==============================================================================
+    // A part of a file on its way to curl, hashed as it's read so the part
+    // only has to be read the once
+    class PartReader  : public InputStream
+    {
+    public:
+        PartReader (InputStream& source_, int64 length_)
+            : source (source_), length (length_) {}
+        
+        int read (void* destBuffer, int maxBytesToRead)
+        {
+            const int numRead = source.read (destBuffer, (int) jmin ((int64) maxBytesToRead, length - md5.getNumBytes()));
+            
+            if (numRead > 0)
+                md5.update (destBuffer, (size_t) numRead);
+            
+            return numRead;
+        }
+        
+        int64 getTotalLength()      { return length; }
+        bool isExhausted()          { return md5.getNumBytes() >= length; }
+        int64 getPosition()         { return md5.getNumBytes(); }
+        bool setPosition (int64)    { return false; }
+        
+        String getMD5() const       { return md5.toHexString(); }
+        
+    private:
+        InputStream& source;
+        const int64 length;
+        ResumableMD5 md5;
+        
+        JUCE_DECLARE_NON_COPYABLE (PartReader);
+    };
+}
+
 //==============================================================================
 const S3ObjectInfo S3ObjectInfo::empty;
 
+S3ObjectInfo::S3ObjectInfo()
+    : length (0),
+      lastModified (0),
+      status (0),
+      etagParts (0),
+      flags (0),
+      reason (standardReasons.invalidResponse)
+{
+    zerostruct (etag);
+}
+
+S3ObjectInfo::S3ObjectInfo (const String& header)
+    : length (0),
+      lastModified (0),
+      status (0),
+      etagParts (0),
+      flags (0),
+      reason (standardReasons.invalidResponse)
+{
+    zerostruct (etag);
+    parse (header);
+}
+
+//==============================================================================
+void S3ObjectInfo::parse (const String& header)
+{
+    const char* text = header.toUTF8();
+    
+    while (*text != 0)
+    {
+        const char* lineEnd = text;
+        
+        while (*lineEnd != 0 && *lineEnd != '\n')
+            ++lineEnd;
+        
+        const char* end = lineEnd;
+        
+        if (end > text && end[-1] == '\r')
+            --end;
+        
+        parseLine (text, end);
+        
+        text = *lineEnd != 0 ? lineEnd + 1 : lineEnd;
+    }
+}
+
+void S3ObjectInfo::parseLine (const char* line, const char* end)
+{
+    // A status line starts a new response, curl dumps all of them when it
+    // follows a redirect or gets a 100 Continue, we only want the last
+    if (startsWithIgnoreCase (line, end, "http"))
+    {
+        length = 0;
+        lastModified = 0;
+        etagParts = 0;
+        flags = 0;
+        extras = nullptr;
+        zerostruct (etag);
+        
+        const char* p = line;
+        
+        while (p < end && *p != ' ')
+            ++p;
+        
+        while (p < end && *p == ' ')
+            ++p;
+        
+        int code = 0;
+        
+        while (p < end && *p >= '0' && *p <= '9')
+            code = code * 10 + (*p++ - '0');
+        
+        while (p < end && *p == ' ')
+            ++p;
+        
+        status = (int16) code;
+        reason = standardReasons.find (p, end);
+        
+        if (reason.getAddress() == nullptr)
+            reason = getHeaderPool().getPooledString (String (CharPointer_UTF8 (p), CharPointer_UTF8 (end)));
+        return;
+    }
+    
+    const char* colon = line;
+    
+    while (colon < end && *colon != ':')
+        ++colon;
+    
+    if (colon == end || status == 0)
+        return;
+    
+    const char* nameEnd = colon;
+    
+    while (nameEnd > line && nameEnd[-1] == ' ')
+        --nameEnd;
+    
+    const char* value = colon + 1;
+    
+    while (value < end && (*value == ' ' || *value == '\t'))
+        ++value;
+    
+    const char* valueEnd = end;
+    
+    while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t'))
+        --valueEnd;
+    
+    if (matchesIgnoreCase (line, nameEnd, "content-length"))
+    {
+        int64 v = 0;
+        
+        for (const char* p = value; p < valueEnd && *p >= '0' && *p <= '9'; ++p)
+            v = v * 10 + (*p - '0');
+        
+        length = v;
+    }
+    else if (matchesIgnoreCase (line, nameEnd, "etag"))
+    {
+        int parts = 0;
+        
+        if (parseETag (String (CharPointer_UTF8 (value), CharPointer_UTF8 (valueEnd)), etag, parts))
+        {
+            etagParts = (uint16) parts;
+            flags |= flagHasETag;
+        }
+    }
+    else if (matchesIgnoreCase (line, nameEnd, "last-modified"))
+    {
+        lastModified = parseHttpDate (String (CharPointer_UTF8 (value), CharPointer_UTF8 (valueEnd)));
+    }
+    else if ((startsWithIgnoreCase (line, nameEnd, "x-amz-")
+               && ! matchesIgnoreCase (line, nameEnd, "x-amz-id-2")
+               && ! matchesIgnoreCase (line, nameEnd, "x-amz-request-id"))
+             || startsWithIgnoreCase (line, nameEnd, "content-")
+             || matchesIgnoreCase (line, nameEnd, "cache-control")
+             || matchesIgnoreCase (line, nameEnd, "expires"))
+    {
+        if (extras == nullptr)
+            extras = new ExtraHeaders();
+        
+        extras->names.add (getHeaderPool().getPooledString (String (CharPointer_UTF8 (line), CharPointer_UTF8 (nameEnd)).toLowerCase()));
+        extras->values.add (String (CharPointer_UTF8 (value), CharPointer_UTF8 (valueEnd)));
+    }
+}
+
+//==============================================================================
+String S3ObjectInfo::getResult() const
+{
+    return String (reason);
+}
+
+//==============================================================================
+String S3ObjectInfo::getMD5() const
+{
+    if (! hasETag())
+        return String::empty;
+    
+    String md5 (String::toHexString (etag, 16, 0));
+    
+    if (etagParts > 0)
+        md5 << "-" << (int) etagParts;
+    
+    return md5;
+}
+
+bool S3ObjectInfo::matchesMD5 (const String& md5Hex) const
+{
+    uint8 other[16];
+    int parts = 0;
+    
+    return hasETag() && etagParts == 0
+            && parseETag (md5Hex, other, parts) && parts == 0
+            && memcmp (etag, other, sizeof (etag)) == 0;
+}
+
+//==============================================================================
+String S3ObjectInfo::getHeader (const String& name) const
+{
+    if (extras != nullptr)
+    {
+        for (int n = 0; n < extras->names.size(); n++)
+        {
+            if (name.equalsIgnoreCase (String (extras->names.getUnchecked (n))))
+                return extras->values[n];
+        }
+    }
+    
+    return String::empty;
+}
+
+StringArray S3ObjectInfo::getHeaderNames() const
+{
+    StringArray names;
+    
+    if (extras != nullptr)
+        for (int n = 0; n < extras->names.size(); n++)
+            names.add (String (extras->names.getUnchecked (n)));
+    
+    return names;
+}
+
+//==============================================================================
+String S3ObjectInfo::toString() const
+{
+    if (! isValid())
+        return getResult();
+    
+    String text;
+    text << "HTTP/1.1 " << (int) status << " " << getResult() << "\n"
+         << "Content-Length: " << String (length) << "\n";
+    
+    if (hasETag())
+        text << "ETag: \"" << getMD5() << "\"\n";
+    
+    if (lastModified != 0)
+        text << "Last-Modified: " << Time (lastModified).toString (true, true, true, true) << "\n";
+    
+    if (extras != nullptr)
+        for (int n = 0; n < extras->names.size(); n++)
+            text << String (extras->names.getUnchecked (n)) << ": " << extras->values[n] << "\n";
+    
+    return text;
+}
+
+//==============================================================================
+int64 S3ObjectInfo::parseHttpDate (const String& text)
+{
+    // Skip the day name
+    StringArray tokens;
+    tokens.addTokens (text.fromFirstOccurrenceOf (",", false, false), " :", String::empty);
+    tokens.removeEmptyStrings();
+    
+    if (tokens.size() < 6)
+        return 0;
+    
+    return toMillisecondsUTC (tokens[2].getIntValue(), monthFromName (tokens[1]), tokens[0].getIntValue(),
+                              tokens[3].getIntValue(), tokens[4].getIntValue(), tokens[5].getIntValue());
+}
+
+int64 S3ObjectInfo::parseISO8601 (const String& text)
+{
+    const char* p = text.toUTF8();
+    int v[5] = { 0 };
+    
+    // YYYY-MM-DDTHH:MM
+    for (int field = 0; field < 5; ++field)
+    {
+        if (*p < '0' || *p > '9')
+            return 0;
+        
+        while (*p >= '0' && *p <= '9')
+            v[field] = v[field] * 10 + (*p++ - '0');
+        
+        if (*p != 0)
+            ++p;
+    }
+    
+    return toMillisecondsUTC (v[0], v[1], v[2], v[3], v[4], String (CharPointer_UTF8 (p)).getDoubleValue());
+}
+
+//==============================================================================
+bool S3ObjectInfo::parseETag (const String& text, uint8* md5, int& parts)
+{
+    String t (text.trim().unquoted());
+    
+    parts = 0;
+    
+    if (t.length() > 32)
+    {
+        if (t[32] != '-')
+            return false;
+        
+        parts = t.substring (33).getIntValue();
+        
+        if (parts <= 0 || parts > 65535)
+            return false;
+    }
+    else if (t.length() != 32)
+    {
+        return false;
+    }
+    
+    for (int i = 0; i < 16; ++i)
+    {
+        const int hi = hexValue (t[i * 2]);
+        const int lo = hexValue (t[i * 2 + 1]);
+        
+        if (hi < 0 || lo < 0)
+            return false;
+        
+        md5[i] = (uint8) ((hi << 4) | lo);
+    }
+    
+    return true;
+}
+
+
+//==============================================================================
+//==============================================================================
+// Checks cached copies in the background for stale-while-revalidate, one
+// request at a time
+class AmazonS3::CacheRevalidator  : public Thread
+{
+public:
+    CacheRevalidator (AmazonS3& owner_)
+        : Thread ("S3 cache revalidation"), owner (owner_) {}
+    
+    ~CacheRevalidator()
+    {
+        signalThreadShouldExit();
+        notify();
+        stopThread (-1);
+    }
+    
+    // Any thread can add, the thread is started by whichever gets here first
+    void add (const S3Object& object)
+    {
+        const ScopedLock sl (lock);
+        
+        const String name (object.getBucket() + "/" + object.getId());
+        
+        if (! names.contains (name))
+        {
+            names.add (name);
+            objects.add (new S3Object (object.getBucket(), object.getId()));
+            
+            if (! isThreadRunning())
+                startThread();
+            
+            notify();
+        }
+    }
+    
+    void run()
+    {
+        while (! threadShouldExit())
+        {
+            ScopedPointer<S3Object> object;
+            
+            {
+                const ScopedLock sl (lock);
+                
+                if (objects.size() > 0)
+                    object = objects.removeAndReturn (0);
+            }
+            
+            if (object == nullptr)
+            {
+                wait (-1);
+                continue;
+            }
+            
+            String etag;
+            File body;
+            
+            if (owner.objectCache != nullptr
+                 && owner.objectCache->lookup (object->getBucket(), object->getId(), etag, body))
+                owner.fetchIntoCache (*object, etag);
+            
+            const ScopedLock sl (lock);
+            names.removeString (object->getBucket() + "/" + object->getId());
+        }
+    }
+    
+private:
+    AmazonS3& owner;
+    CriticalSection lock;
+    OwnedArray<S3Object> objects;
+    StringArray names;
+    
+    JUCE_DECLARE_NON_COPYABLE (CacheRevalidator);
+};
+
+//==============================================================================
+// A multipart copy in progress, shared by the threads copying its parts
+struct AmazonS3::CopyJob
+{
+    CopyJob (const S3Object& source_, const S3Object& destination_, const String& uploadId_,
+             const String& sourceETag_, int64 size_, int64 partSize_)
+        : source (source_), destination (destination_), uploadId (uploadId_),
+          sourceETag (sourceETag_), size (size_), partSize (partSize_),
+          numParts ((int) ((size_ + partSize_ - 1) / partSize_)),
+          nextPart (1), failed (false)
+    {
+        for (int i = 0; i < numParts; ++i)
+            etags.add (String::empty);
+    }
+    
+    const S3Object source, destination;
+    const String uploadId, sourceETag;
+    const int64 size, partSize;
+    const int numParts;
+    
+    CriticalSection lock;
+    StringArray etags;
+    int nextPart;
+    bool failed;
+};
+
+//==============================================================================
+class AmazonS3::PartCopier  : public Thread
+{
+public:
+    PartCopier (AmazonS3& owner_, CopyJob& job_)
+        : Thread ("S3 part copy"), owner (owner_), job (job_) {}
+    
+    void run()
+    {
+        while (! threadShouldExit())
+        {
+            int part;
+            
+            {
+                const ScopedLock sl (job.lock);
+                
+                // One failure sinks the whole copy, no point carrying on
+                if (job.failed || job.nextPart > job.numParts)
+                    return;
+                
+                part = job.nextPart++;
+            }
+            
+            const int64 first = (part - 1) * job.partSize;
+            const int64 last = jmin (job.size, first + job.partSize) - 1;
+            
+            const String etag (owner.copyPart (job.source, job.destination, job.uploadId,
+                                               part, first, last, job.sourceETag));
+            
+            const ScopedLock sl (job.lock);
+            
+            if (etag.isEmpty())
+                job.failed = true;
+            else
+                job.etags.set (part - 1, etag);
+        }
+    }
+    
+private:
+    AmazonS3& owner;
+    CopyJob& job;
+    
+    JUCE_DECLARE_NON_COPYABLE (PartCopier);
+};
+
+//==============================================================================
+struct AmazonS3::UploadJob
+{
+    UploadJob (const S3Object& object_, const File& file_, const String& uploadId_,
+               UploadJournal& journal_, int64 size_, int64 partSize_,
+               const StringArray& etags_, const StringArray& checksums_)
+        : object (object_), file (file_), uploadId (uploadId_), journal (journal_),
+          size (size_), partSize (partSize_), etags (etags_), checksums (checksums_),
+          failed (false)
+    {
+    }
+    
+    const S3Object object;
+    const File file;
+    const String uploadId;
+    UploadJournal& journal;
+    const int64 size, partSize;
+    
+    CriticalSection lock;
+    StringArray etags, checksums;
+    bool failed;
+};
+
+//==============================================================================
+class AmazonS3::PartUpload  : public WorkQueue::Job
+{
+public:
+    PartUpload (AmazonS3& owner_, UploadJob& job_, int part_)
+        : owner (owner_), job (job_), part (part_) {}
+    
+    void run()
+    {
+        {
+            const ScopedLock sl (job.lock);
+            
+            // One failure sinks the whole upload, no point sending more
+            if (job.failed)
+                return;
+        }
+        
+        const int64 start = (part - 1) * job.partSize;
+        String checksum;
+        
+        const String etag (owner.uploadPart (job.object, job.uploadId, part, job.file,
+                                             start, jmin (job.partSize, job.size - start), checksum));
+        
+        const ScopedLock sl (job.lock);
+        
+        if (etag.isEmpty())
+        {
+            job.failed = true;
+        }
+        else
+        {
+            job.etags.set (part - 1, etag);
+            job.checksums.set (part - 1, checksum);
+            job.journal.setPartETag (part, etag);
+        }
+    }
+    
+private:
+    AmazonS3& owner;
+    UploadJob& job;
+    const int part;
+    
+    JUCE_DECLARE_NON_COPYABLE (PartUpload);
+};
+
+//==============================================================================
+// Out of line, the revalidator's type is only complete in here
+AmazonS3::AmazonS3 (const String& credentials_, const String& secret_)
+    : credentials (credentials_),
+      secret (secret_),
+      checksumType (Checksum::md5),
+      compressUploads (false),
+      hashIndex (nullptr),
+      metadataCache (nullptr),
+      objectCache (nullptr),
+      hotCache (nullptr),
+      bloomFilter (nullptr)
+{
+    // Made up front rather than when first needed, as that could be on
+    // several threads at once
+    revalidator = new CacheRevalidator (*this);
+}
+
+AmazonS3::~AmazonS3()
+{
+    // Waits for a revalidation in flight, it uses our members
+    revalidator = nullptr;
+}
+
+//==============================================================================
+bool AmazonS3::getObject (S3Object& object, const File& file)
+{
+    return downloadObject (object, file, nullptr);
+}
+
+bool AmazonS3::getObject (S3Object& object, const File& file, const ListBucketParser::Entry& listed)
+{
+    String header ("HTTP/1.1 200 OK\r\nContent-Length: " + String (listed.size) + "\r\n");
+    
+    if (listed.hasETag)
+    {
+        header << "ETag: \"" << String::toHexString (listed.etag, sizeof (listed.etag), 0);
+        
+        if (listed.etagParts > 0)
+            header << "-" << listed.etagParts;
+        
+        header << "\"\r\n";
+    }
+    
+    const S3ObjectInfo listedInfo (header);
+    return downloadObject (object, file, &listedInfo);
+}
+
+bool AmazonS3::downloadObject (S3Object& object, const File& file, const S3ObjectInfo* listedInfo)
+{
+    object.clearFileAndInfo();
+    
+    // Whole objects come through the cache if there is one
+    if (objectCache != nullptr && object.getId().isNotEmpty() && ! object.getId().containsChar ('?'))
+    {
+        ScopedPointer<MemoryMappedFile> mapped (openCachedObject (object));
+        
+        if (mapped == nullptr || ! writeMappedFile (*mapped, file))
+            return false;
+        
+        if (hashIndex != nullptr)
+            hashIndex->setRemoteETag (file, object.getInfo().getMD5());
+        
+        object.setFile (file);
+        return true;
+    }
+    
+    // A cached HEAD or a listing is out of date if the object has been
+    // replaced since, so a download that doesn't match one is tried again
+    // with a fresh HEAD
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        S3ObjectInfo objInfo;
+        bool fromCache = false;
+        const bool useListed = listedInfo != nullptr && attempt == 0;
+        
+        if (useListed)
+        {
+            objInfo = *listedInfo;
+            object.setInfo (objInfo);
+            fromCache = true;
+        }
+        // We can't get info for sub-elements
+        else if (! object.getId().containsChar ('?'))
+        {
+            if (! updateObjectInfo (object, fromCache))
+                return false;
+        
+            objInfo = object.getInfo();
+        
+            if (! objInfo.isSuccess())
+                return false;
+        }
+        
+        String url = createURL ("get", object);
+        
+        // Compressed objects are checked as they came and unzipped after.  A
+        // listing can't say, so then it's the GET's own headers that do.
+        bool gzipped = isGzipEncoded (objInfo);
+        ScopedPointer<TemporaryFile> download (gzipped ? new TemporaryFile (file) : nullptr);
+        const File target (gzipped ? download->getFile() : file);
+        
+        String result = runCurl ("--request GET --create-dirs --output '" + 
+                                 target.getFullPathName() + "' " +
+                                 (useListed ? "--dump-header - " : "") +
+                                 "--location '" + url + "'");
+        
+        if (useListed)
+        {
+            // Redirects come first, the last block is the object's
+            const S3ObjectInfo response (result.fromLastOccurrenceOf ("HTTP/", true, false));
+            
+            if (! response.isSuccess())
+            {
+                target.deleteFile();
+                return false;
+            }
+            
+            gzipped = isGzipEncoded (response);
+        }
+        else if (result.isNotEmpty())
+        {
+            return false;
+        }
+        
+        // Nothing to match up on sub-element, just try to parse the XML results
+        if (object.getId().containsChar ('?'))
+        {
+            object.setInfo (S3ObjectInfo ("HTTP 200 OK"));
+            return true;
+        }
+        
+        // We can't verify the length and md5 of directory requests, again, just
+        // verify the XML
+        if (! object.getId().length())
+            return true;
+        
+        // Temp files mustn't end up in the hash index
+        if (! verifyFile (objInfo, target, ! gzipped))
+        {
+            if (metadataCache != nullptr)
+                metadataCache->remove (object.getBucket(), object.getId());
+            
+            // Nothing that failed the check is left behind
+            target.deleteFile();
+            
+            if (fromCache)
+                continue;
+            
+            return false;
+        }
+        
+        if (gzipped && ! gunzipFile (target, file))
+            return false;
+        
+        if (hashIndex != nullptr)
+            hashIndex->setRemoteETag (file, objInfo.getMD5());
+        
+        if (metadataCache != nullptr)
+            metadataCache->store (object.getBucket(), object.getId(), objInfo);
+        
+        object.setFile (file);
+        return true;
+    }
+    
+    return false;
+}
+
+bool AmazonS3::getObjectResumable (S3Object& object, const File& file)
+{
+    object.clearFileAndInfo();
+    
+    if (object.getId().isEmpty() || object.getId().containsChar ('?'))
+        return false;
+    
+    const File resumeFile (getResumeFile (file));
+    
+    // Once more if the object changes under us
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        if (! updateObjectInfo (object))
+            return false;
+        
+        const S3ObjectInfo info (object.getInfo());
+        
+        // Nothing to tell one version from another
+        if (! info.hasETag())
+            return getObject (object, file);
+        
+        const String etag (info.getMD5());
+        
+        ResumableMD5 md5;
+        int64 offset = loadResumeState (resumeFile, etag, md5);
+        
+        if (offset > file.getSize() || offset > info.getLength())
+        {
+            md5.reset();
+            offset = 0;
+        }
+        
+        if (! file.getParentDirectory().createDirectory())
+            return false;
+        
+        S3ObjectInfo response (info);
+        
+        if (offset < info.getLength() || offset == 0)
+        {
+            FileOutputStream out (file);
+            
+            if (out.failedToOpen())
+                return false;
+            
+            // Anything past the last checkpoint can't be trusted
+            out.setPosition (offset);
+            out.truncate();
+            
+            String header ("--header 'If-Match:\"" + etag + "\"' ");
+            
+            if (offset > 0)
+                header += "--header 'Range:bytes=" + String (offset) + "-' ";
+            
+            ResumeWriter writer (out, md5, resumeFile, etag);
+            
+            runCurl (header + "--request GET --dump-header - --location '" + createURL ("get", object) + "'", writer);
+            
+            writer.checkpoint();
+            response = writer.getInfo();
+        }
+        
+        if (response.getStatus() == 412)
+        {
+            resumeFile.deleteFile();
+            
+            if (metadataCache != nullptr)
+                metadataCache->remove (object.getBucket(), object.getId());
+            
+            continue;
+        }
+        
+        // Cut off, the next call carries on from the checkpoint
+        if (! response.isSuccess() || md5.getNumBytes() != info.getLength())
+            return false;
+        
+        resumeFile.deleteFile();
+        
+        // The MD5 is already there for single part ETags, otherwise the
+        // file is checked as getObject would
+        const bool verified = info.getETagPartCount() == 0 ? info.matchesMD5 (md5.toHexString())
+                                                           : verifyFile (info, file);
+        
+        if (! verified)
+        {
+            file.deleteFile();
+            
+            if (metadataCache != nullptr)
+                metadataCache->remove (object.getBucket(), object.getId());
+            
+            return false;
+        }
+        
+        if (isGzipEncoded (info) && ! gunzipFile (file, file))
+            return false;
+        
+        if (hashIndex != nullptr)
+            hashIndex->setRemoteETag (file, etag);
+        
+        object.setFile (file);
+        return true;
+    }
+    
+    return false;
+}
+
+bool AmazonS3::putObject (S3Object& object, const File& file, bool makePublic,
+                          bool allowCompression)
+{
+    const bool compress = compressUploads && allowCompression;
+    
+    object.clearFileAndInfo();
+    
+    if (! file.exists())
+        return false;
+    
+    // Nothing to send if the object still holds what we last transferred
+    if (hashIndex != nullptr && ! makePublic)
+    {
+        String lastETag = hashIndex->getRemoteETag (file);
+        
+        if (lastETag.isNotEmpty() && updateObjectInfo (object)
+             && object.getInfo().matchesMD5 (lastETag))
+        {
+            object.setFile (file);
+            return true;
+        }
+        
+        object.clearFileAndInfo();
+    }
+    
+    String header;
+    String amzHeader;
+    
+    if (makePublic)
+    {
+        header += "--header 'x-amz-acl:public-read' ";
+        amzHeader += "x-amz-acl:public-read\n";
+    }
+    
+    // Compressed to a temporary file first, the checksum is of the bytes
+    // that are actually sent and is taken as they're written
+    File body (file);
+    ScopedPointer<TemporaryFile> compressed;
+    String checksum;
+    
+    if (compress)
+    {
+        compressed = new TemporaryFile (".gz");
+        body = compressed->getFile();
+        checksum = gzipFile (file, body, checksumType);
+        
+        if (checksum.isEmpty())
+            return false;
+        
+        header += "--header 'Content-Encoding:gzip' ";
+    }
+    else if (checksumType != Checksum::md5)
+    {
+        checksum = calculateChecksum (checksumType, file);
+        
+        if (checksum.isEmpty())
+            return false;
+    }
+    
+    // Let S3 check the CRC as it receives the body
+    if (checksumType != Checksum::md5)
+    {
+        header += "--header '" + Checksum::getHeaderName (checksumType) + ":" + checksum + "' ";
+        amzHeader += Checksum::getHeaderName (checksumType) + ":" + checksum + "\n";
+    }
+    
+    String url = createURL ("put", object, amzHeader);
+    
+    object.setInfo (S3ObjectInfo (runCurl (header + "--request PUT --dump-header - --upload-file '" +
+                                  body.getFullPathName() + "' " +
+                                  "--location '" + url + "'")));
+    
+    if (metadataCache != nullptr)
+        metadataCache->remove (object.getBucket(), object.getId());
+    
+    if (hotCache != nullptr)
+        hotCache->remove (object.getBucket(), object.getId());
+    
+    if (! object.isSuccess())
+        return false;
+    
+    if (bloomFilter != nullptr && bloomFilter->covers (object.getBucket(), object.getId()))
+        bloomFilter->add (object.getId());
+    
+    if (checksumType != Checksum::md5)
+    {
+        if (checksum != object.getInfo().getHeader (Checksum::getHeaderName (checksumType)))
+            return false;
+    }
+    else
+    {
+        if (! object.getInfo().matchesMD5 (compress ? checksum : calculateChecksum (Checksum::md5, file)))
+            return false;
+    }
+    
+    if (hashIndex != nullptr)
+        hashIndex->setRemoteETag (file, object.getInfo().getMD5());
+    
+    // The PUT response doesn't mention the encoding, a HEAD will have to
+    if (metadataCache != nullptr && ! compress)
+    {
+        S3ObjectInfo info (object.getInfo());
+        info.setLength (file.getSize());
+        info.setLastModified (Time::currentTimeMillis());
+        metadataCache->store (object.getBucket(), object.getId(), info);
+    }
+
+    object.setFile (file);
+    return true;
+}
+
+bool AmazonS3::putObjectMultipart (S3Object& object, const File& file, const File& journalFile,
+                                   int64 partSize, int numThreads)
+{
+    object.clearFileAndInfo();
+    
+    if (compressUploads)
+        return false;
+    
+    if (! file.existsAsFile() || object.getId().isEmpty() || object.getId().containsChar ('?'))
+        return false;
+    
+    // Nothing to send if the object still holds what we last transferred
+    if (hashIndex != nullptr)
+    {
+        const String lastETag (hashIndex->getRemoteETag (file));
+        
+        if (lastETag.isNotEmpty() && updateObjectInfo (object)
+             && object.getInfo().getMD5().equalsIgnoreCase (lastETag))
+        {
+            object.setFile (file);
+            return true;
+        }
+        
+        object.clearFileAndInfo();
+    }
+    
+    const int64 fileSize = file.getSize();
+    
+    // Without it parts are only checked by their MD5 ETags
+    const String checksumAlgorithm (Checksum::getAlgorithmName (checksumType));
+    
+    UploadJournal journal (journalFile);
+    String uploadId;
+    
+    if (journal.matches (object.getBucket(), object.getId(), file, checksumAlgorithm))
+    {
+        // Carry on with the part size it was started with
+        uploadId = journal.getUploadId();
+        partSize = journal.getPartSize();
+    }
+    else
+    {
+        // Left over from another file, or this one before it changed
+        if (journal.getUploadId().isNotEmpty())
+            abortMultipartUpload (journalFile);
+        
+        partSize = jmax (partSize, (int64) minPartSize, (fileSize + maxParts - 1) / maxParts);
+    }
+    
+    const int numParts = (int) jmax ((int64) 1, (fileSize + partSize - 1) / partSize);
+    StringArray etags, checksums;
+    
+    if (uploadId.isNotEmpty())
+    {
+        StringArray uploaded, uploadedChecksums;
+        bool uploadExists = true;
+        
+        if (listUploadedParts (object, uploadId, uploaded, uploadedChecksums, uploadExists))
+        {
+            // S3 is the judge of what's there; a part the journal doesn't know
+            // about (the crash came before it was noted) is kept if it holds
+            // the same bytes we would have sent
+            for (int part = 1; part <= numParts; ++part)
+            {
+                const String remote (uploaded [part - 1]);
+                const String checksum (uploadedChecksums [part - 1]);
+                
+                if (remote.isEmpty() || (checksumAlgorithm.isNotEmpty() && checksum.isEmpty()))
+                {
+                    etags.add (String::empty);
+                }
+                else if (remote.equalsIgnoreCase (journal.getPartETag (part)))
+                {
+                    etags.add (remote);
+                }
+                else
+                {
+                    const int64 start = (part - 1) * partSize;
+                    FileInputStream in (file);
+                    
+                    if (in.openedOk() && in.setPosition (start)
+                         && remote.equalsIgnoreCase (MD5 (in, jmin (partSize, fileSize - start)).toHexString()))
+                    {
+                        etags.add (remote);
+                        journal.setPartETag (part, remote);
+                    }
+                    else
+                    {
+                        etags.add (String::empty);
+                    }
+                }
+                
+                checksums.add (etags[part - 1].isNotEmpty() ? checksum : String::empty);
+            }
+        }
+        else if (uploadExists)
+        {
+            // Couldn't ask, try again later rather than throw the parts away
+            return false;
+        }
+        else
+        {
+            // Completed or aborted behind our back
+            uploadId = String::empty;
+        }
+    }
+    
+    if (uploadId.isEmpty())
+    {
+        String headers, amzHeader;
+        
+        if (checksumAlgorithm.isNotEmpty())
+        {
+            headers = "--header 'x-amz-checksum-algorithm:" + checksumAlgorithm + "' ";
+            amzHeader = "x-amz-checksum-algorithm:" + checksumAlgorithm + "\n";
+        }
+        
+        uploadId = startMultipartUpload (object, headers, amzHeader);
+        
+        if (uploadId.isEmpty()
+             || ! journal.start (object.getBucket(), object.getId(), file, partSize, uploadId, checksumAlgorithm))
+            return false;
+        
+        etags.clear();
+        checksums.clear();
+        
+        for (int part = 1; part <= numParts; ++part)
+        {
+            etags.add (String::empty);
+            checksums.add (String::empty);
+        }
+    }
+    
+    UploadJob job (object, file, uploadId, journal, fileSize, partSize, etags, checksums);
+    
+    {
+        WorkQueue uploads ("S3 part upload", jmin (jmax (1, numThreads), numParts));
+        
+        for (int part = 1; part <= numParts; ++part)
+            if (etags [part - 1].isEmpty())
+                uploads.add (new PartUpload (*this, job, part));
+        
+        uploads.finish();
+    }
+    
+    if (job.failed || ! completeMultipartUpload (object, uploadId, job.etags, job.checksums))
+        return false;
+    
+    journal.remove();
+    
+    S3ObjectInfo info (object.getInfo());
+    info.setLength (fileSize);
+    info.setLastModified (Time::currentTimeMillis());
+    object.setInfo (info);
+    
+    if (metadataCache != nullptr)
+        metadataCache->remove (object.getBucket(), object.getId());
+    
+    if (hotCache != nullptr)
+        hotCache->remove (object.getBucket(), object.getId());
+    
+    if (bloomFilter != nullptr && bloomFilter->covers (object.getBucket(), object.getId()))
+        bloomFilter->add (object.getId());
+    
+    if (hashIndex != nullptr)
+        hashIndex->setRemoteETag (file, info.getMD5());
+    
+    object.setFile (file);
+    return true;
+}
+
+bool AmazonS3::abortMultipartUpload (const File& journalFile)
+{
+    UploadJournal journal (journalFile);
+    
+    if (journal.getUploadId().isEmpty())
+    {
+        journal.remove();
+        return true;
+    }
+    
+    if (! abortUpload (S3Object (journal.getBucket(), journal.getKey()), journal.getUploadId()))
+        return false;
+    
+    journal.remove();
+    return true;
+}
+
+bool AmazonS3::deleteObject (S3Object& object)
+{
+    object.clearFileAndInfo();
+    
+    if (object.getId().isEmpty() || object.getId().containsChar ('?'))
+        return false;
+    
+    object.setInfo (S3ObjectInfo (runCurl ("--request DELETE --dump-header - --location '" +
+                                           createURL ("delete", object) + "'")));
+    
+    forgetObject (object.getBucket(), object.getId());
+    
+    return object.isSuccess();
+}
+
+bool AmazonS3::deleteObjects (const String& bucket, const StringArray& keys, DeleteListener& listener)
+{
+    jassert (keys.size() <= maxKeysPerDelete);
+    
+    if (keys.size() == 0)
+        return true;
+    
+    // Quiet, so only the failures come back
+    String body ("<Delete><Quiet>true</Quiet>");
+    
+    for (int i = 0; i < keys.size(); ++i)
+        body << "<Object><Key>" << escapeXml (keys[i]) << "</Key></Object>";
+    
+    body << "</Delete>";
+    
+    const MemoryBlock data (body.toUTF8(), body.getNumBytesAsUTF8());
+    const String contentMD5 (Base64::encode (MD5 (data).getRawChecksumData()));
+    
+    TemporaryFile temp (".xml");
+    
+    if (! temp.getFile().replaceWithData (data.getData(), data.getSize()))
+        return false;
+    
+    // S3 won't take a multi-object delete without a Content-MD5
+    S3Object request (bucket, "?delete");
+    
+    ScopedPointer<XmlElement> xml (XmlDocument::parse (runCurl ("--request POST --header 'Content-MD5:" + contentMD5 + "' " +
+                                                                "--upload-file '" + temp.getFile().getFullPathName() + "' " +
+                                                                "--location '" + createURL ("post", request, String::empty,
+                                                                                            String::empty, contentMD5) + "'")));
+    
+    if (xml == nullptr || ! xml->hasTagName ("DeleteResult"))
+    {
+        const String error (xml != nullptr ? xml->getChildElementAllSubText ("Code", String::empty)
+                                           : String ("No response"));
+        
+        for (int i = 0; i < keys.size(); ++i)
+            listener.deleteFailed (keys[i], error);
+        
+        return false;
+    }
+    
+    HashMap<String, String> errors;
+    
+    forEachXmlChildElementWithTagName (*xml, e, "Error")
+        errors.set (e->getChildElementAllSubText ("Key", String::empty),
+                    e->getChildElementAllSubText ("Code", String::empty));
+    
+    for (int i = 0; i < keys.size(); ++i)
+    {
+        if (errors.contains (keys[i]))
+        {
+            listener.deleteFailed (keys[i], errors [keys[i]]);
+        }
+        else
+        {
+            // Only what's really gone, a failed key's cached copy is still good
+            forgetObject (bucket, keys[i]);
+            listener.objectDeleted (keys[i]);
+        }
+    }
+    
+    return errors.size() == 0;
+}
+
+bool AmazonS3::copyObject (const S3Object& source, S3Object& destination, int numThreads)
+{
+    destination.clearFileAndInfo();
+    
+    if (source.getId().isEmpty() || source.getId().containsChar ('?')
+         || destination.getId().isEmpty() || destination.getId().containsChar ('?'))
+        return false;
+    
+    // The size picks the method, the ETag pins the version for every part.
+    // It has to be a real HEAD, a cached PUT response has no headers to copy.
+    S3Object sourceInfo (source);
+    
+    if (metadataCache != nullptr)
+        metadataCache->remove (source.getBucket(), source.getId());
+    
+    if (! updateObjectInfo (sourceInfo))
+        return false;
+    
+    const int64 size = sourceInfo.getInfo().getLength();
+    const String sourceETag (sourceInfo.getInfo().getMD5());
+    
+    // Without an ETag there's nothing to hold the parts to one version
+    if (sourceETag.isEmpty())
+        return false;
+    
+    const String copySource (getCopySource (source));
+    
+    // Both ways of copying set the headers from the same HEAD, rather than
+    // one leaving it to S3
+    String contentType, headers, metadata;
+    getCopiedHeaders (sourceInfo.getInfo(), contentType, headers, metadata);
+    
+    bool ok;
+    
+    if (size <= maxSingleCopySize)
+    {
+        // x-amz headers are signed in alphabetical order
+        const String amzHeader ("x-amz-copy-source:" + copySource + "\n" +
+                                "x-amz-copy-source-if-match:" + sourceETag + "\n" +
+                                metadata +
+                                "x-amz-metadata-directive:REPLACE\n");
+        
+        // Errors can come back after a 200, the body says how it went
+        ScopedPointer<XmlElement> xml (XmlDocument::parse (runCurl ("--header 'x-amz-copy-source:" + copySource + "' " +
+                                                                    "--header 'x-amz-copy-source-if-match:" + sourceETag + "' " +
+                                                                    headers +
+                                                                    "--header 'x-amz-metadata-directive:REPLACE' " +
+                                                                    "--request PUT --location '" +
+                                                                    createURL ("put", destination, amzHeader,
+                                                                               String::empty, String::empty,
+                                                                               contentType) + "'")));
+        
+        ok = xml != nullptr && xml->hasTagName ("CopyObjectResult");
+        
+        if (ok)
+            destination.setInfo (S3ObjectInfo ("HTTP/1.1 200 OK\r\nETag: " +
+                                               xml->getChildElementAllSubText ("ETag", String::empty).trim() + "\r\n"));
+    }
+    else
+    {
+        const int64 partSize = jmax ((int64) defaultCopyPartSize, (size + maxParts - 1) / maxParts);
+        
+        const String uploadId (startMultipartUpload (destination, headers, metadata, contentType));
+        
+        if (uploadId.isEmpty())
+            return false;
+        
+        CopyJob job (source, destination, uploadId, sourceETag, size, partSize);
+        
+        {
+            OwnedArray<PartCopier> copiers;
+            
+            for (int n = jmin (jmax (1, numThreads), job.numParts); --n >= 0;)
+            {
+                PartCopier* const copier = new PartCopier (*this, job);
+                copiers.add (copier);
+                copier->startThread();
+            }
+            
+            for (int n = 0; n < copiers.size(); ++n)
+                copiers.getUnchecked (n)->waitForThreadToExit (-1);
+        }
+        
+        ok = ! job.failed && completeMultipartUpload (destination, uploadId, job.etags);
+        
+        // Otherwise S3 would keep the copied parts
+        if (! ok)
+            abortUpload (destination, uploadId);
+    }
+    
+    forgetObject (destination.getBucket(), destination.getId());
+    
+    if (! ok)
+        return false;
+    
+    S3ObjectInfo info (destination.getInfo());
+    info.setLength (size);
+    info.setLastModified (Time::currentTimeMillis());
+    destination.setInfo (info);
+    
+    if (bloomFilter != nullptr && bloomFilter->covers (destination.getBucket(), destination.getId()))
+        bloomFilter->add (destination.getId());
+    
+    return true;
+}
+
+MemoryMappedFile* AmazonS3::mapObject (S3Object& object)
+{
+    return objectCache != nullptr ? openCachedObject (object) : nullptr;
+}
+
+HotObjectCache::Buffer::Ptr AmazonS3::readObject (S3Object& object)
+{
+    if (hotCache != nullptr)
+    {
+        HotObjectCache::Buffer::Ptr buffer (hotCache->lookup (object.getBucket(), object.getId()));
+        
+        if (buffer != nullptr)
+            return buffer;
+    }
+    
+    MemoryBlock data;
+    
+    if (objectCache != nullptr)
+    {
+        ScopedPointer<MemoryMappedFile> mapped (openCachedObject (object));
+        
+        if (mapped == nullptr)
+            return nullptr;
+        
+        data.append (mapped->getData(), mapped->getSize());
+    }
+    else
+    {
+        // As with downloads, a cached HEAD that doesn't match what came
+        // back may be out of date, so it's tried once more with a fresh one
+        for (int attempt = 0;; ++attempt)
+        {
+            bool fromCache = false;
+            
+            if (! updateObjectInfo (object, fromCache))
+                return nullptr;
+            
+            data.setSize (0);
+            
+            {
+                MemoryOutputStream out (data, false);
+                
+                if (! runCurl ("--request GET --location '" + createURL ("get", object) + "'", out))
+                    return nullptr;
+            }
+            
+            if (verifyData (object.getInfo(), data))
+                break;
+            
+            if (metadataCache != nullptr)
+                metadataCache->remove (object.getBucket(), object.getId());
+            
+            if (! fromCache || attempt > 0)
+                return nullptr;
+        }
+        
+        if (isGzipEncoded (object.getInfo()))
+        {
+            MemoryBlock unzipped;
+            
+            {
+                MemoryInputStream in (data, false);
+                MemoryOutputStream out (unzipped, false);
+                
+                if (! gunzip (in, out))
+                    return nullptr;
+            }
+            
+            data.swapWith (unzipped);
+        }
+    }
+    
+    HotObjectCache::Buffer::Ptr buffer (new HotObjectCache::Buffer (data, object.getInfo().getMD5()));
+    
+    if (hotCache != nullptr)
+        hotCache->store (object.getBucket(), object.getId(), buffer);
+    
+    return buffer;
+}
+
+bool AmazonS3::readRange (S3Object& object, int64 start, int64 numBytes, MemoryBlock& data)
+{
+    data.setSize (0);
+    
+    if (numBytes <= 0)
+        return numBytes == 0;
+    
+    MemoryOutputStream out (data, false);
+    
+    // An error document wouldn't be the right length either
+    if (! runCurl ("--request GET --range " + String (start) + "-" + String (start + numBytes - 1) +
+                   " --location '" + createURL ("get", object) + "'", out))
+        return false;
+    
+    out.flush();
+    return (int64) data.getSize() == numBytes;
+}
+
+//==============================================================================
+bool AmazonS3::getDirectory (const String& bucket, StringArray& list, const String& prefix)
+{
+    list.clear();
+    
+    ListOptions options;
+    options.prefix = prefix;
+    
+    // Keys are picked out of each page as curl hands it over, nothing goes
+    // to disk and no XmlElement tree gets built
+    KeyCollector collector (list);
+    return listAll (bucket, options, collector);
+}
+
+bool AmazonS3::getDirectory (const String& bucket, KeyTable& table, const String& prefix)
+{
+    table.clear();
+    
+    ListOptions options;
+    options.prefix = prefix;
+    
+    KeyTableCollector collector (table);
+    return listAll (bucket, options, collector) && ! collector.failed();
+}
+
+bool AmazonS3::getDirectory (const String& bucket, ObjectTable& table, const String& prefix)
+{
+    table.clear();
+    
+    ListOptions options;
+    options.prefix = prefix;
+    
+    // Size, ETag and date come with every key, so there's no need for a
+    // HEAD per object afterwards
+    ObjectTableCollector collector (table);
+    return listAll (bucket, options, collector) && ! collector.failed();
+}
+
+bool AmazonS3::fillBloomFilter (BloomFilter& filter)
+{
+    filter.clear();
+    
+    ListOptions options;
+    options.prefix = filter.getPrefix();
+    
+    BloomFilterCollector collector (filter);
+    
+    if (! listAll (filter.getBucket(), options, collector))
+        return false;
+    
+    filter.setReady (true);
+    return true;
+}
+
+bool AmazonS3::listAll (const String& bucket, const ListOptions& options, ListBucketParser::Listener& listener)
+{
+    String continuationToken;
+    
+    for (;;)
+    {
+        ListBucketParser parser (listener);
+        
+        if (! listObjects (bucket, options, continuationToken, parser))
+            return false;
+        
+        continuationToken = parser.getNextContinuationToken();
+        
+        if (! parser.isTruncated() || continuationToken.isEmpty())
+            return true;
+    }
+}
+
 //==============================================================================
-bool S3ObjectInfo::isSuccess()
+bool AmazonS3::listObjects (const String& bucket, const ListOptions& options,
+                            const String& continuationToken, ListBucketParser& parser)
 {
-    return header.fromLastOccurrenceOf ("HTTP", true, false).contains ("200 OK");
+    String query ("list-type=2");
+    
+    if (options.prefix.isNotEmpty())
+        query << "&prefix=" << URL::addEscapeChars (options.prefix, true);
+    
+    if (options.delimiter.isNotEmpty())
+        query << "&delimiter=" << URL::addEscapeChars (options.delimiter, true);
+    
+    if (options.maxKeys > 0)
+        query << "&max-keys=" << options.maxKeys;
+    
+    if (continuationToken.isNotEmpty())
+        query << "&continuation-token=" << URL::addEscapeChars (continuationToken, true);
+    else if (options.startAfter.isNotEmpty())
+        query << "&start-after=" << URL::addEscapeChars (options.startAfter, true);
+    
+    S3Object object (bucket, "");
+    
+    if (! runCurl ("--request GET --location '" + createURL ("get", object, String::empty, query) + "'", parser))
+        return false;
+    
+    return parser.isComplete();
 }
 
-bool S3ObjectInfo::isValid()
+//==============================================================================
+bool AmazonS3::updateObjectInfo (S3Object& object)
 {
-    return header.startsWith ("HTTP");
+    bool fromCache;
+    return updateObjectInfo (object, fromCache);
 }
 
-//==============================================================================
-String S3ObjectInfo::getResult()
+bool AmazonS3::updateObjectInfo (S3Object& object, bool& fromCache)
 {
-    String resultLine = header.fromLastOccurrenceOf ("HTTP", true, false)
-                              .upToFirstOccurrenceOf ("\n", false, false);
+    object.clearFileAndInfo();
+    fromCache = false;
+    
+    // A definite no from the filter, no need to ask
+    if (bloomFilter != nullptr && bloomFilter->isReady()
+         && bloomFilter->covers (object.getBucket(), object.getId())
+         && ! bloomFilter->mightContain (object.getId()))
+    {
+        object.setInfo (S3ObjectInfo ("HTTP/1.1 404 Not Found"));
+        return false;
+    }
+    
+    if (metadataCache != nullptr)
+    {
+        S3ObjectInfo info;
+        
+        if (metadataCache->lookup (object.getBucket(), object.getId(), info))
+        {
+            object.setInfo (info);
+            fromCache = true;
+            return object.isSuccess();
+        }
+    }
     
-    if (! resultLine.startsWith ("HTTP"))
-        return String ("Invalid Response");
+    if (checksumType != Checksum::md5)
+        object.setInfo (S3ObjectInfo (runCurl ("--header 'x-amz-checksum-mode:ENABLED' --head '" +
+                                               createURL ("head", object, "x-amz-checksum-mode:ENABLED\n") + "'")));
+    else
+        object.setInfo (S3ObjectInfo (runCurl ("--head '" + createURL ("head", object) + "'")));
+
+    // Keeps 404s as well, for less time
+    if (metadataCache != nullptr)
+        metadataCache->store (object.getBucket(), object.getId(), object.getInfo());
     
-    // Drop the 'HTTP/1.1 xxx '
-    return resultLine.substring (13);
+    return object.isSuccess();
 }
 
 //==============================================================================
-int S3ObjectInfo::getLength()
+bool AmazonS3::verifyFile (const S3ObjectInfo& info, const File& file, bool useHashIndex)
 {
-    String lString = header.fromFirstOccurrenceOf ("Content-Length: ", false, true)
-                           .upToFirstOccurrenceOf ("\n", false, false);
+    if (file.getSize() != info.getLength())
+        return false;
+    
+    // Prefer the stored CRC, multipart objects only have a composite ("xxx-N")
+    // one which we can't check against the whole file
+    if (checksumType != Checksum::md5)
+    {
+        String expected = info.getHeader (Checksum::getHeaderName (checksumType));
+        
+        if (expected.isNotEmpty() && ! expected.containsChar ('-'))
+            return (useHashIndex ? calculateChecksum (checksumType, file)
+                                 : Checksum::calculate (checksumType, file)) == expected;
+    }
     
-    return lString.getIntValue();
+    // Data file request, compare md5
+    return info.matchesMD5 (useHashIndex ? calculateChecksum (Checksum::md5, file)
+                                         : Checksum::calculate (Checksum::md5, file));
 }
 
-//==============================================================================
-String S3ObjectInfo::getMD5()
+bool AmazonS3::verifyData (const S3ObjectInfo& info, const MemoryBlock& data)
 {
-    return header.fromFirstOccurrenceOf ("Etag: \"", false, true)
-                 .upToFirstOccurrenceOf ("\"", false, false);
+    if ((int64) data.getSize() != info.getLength())
+        return false;
+    
+    if (checksumType != Checksum::md5)
+    {
+        String expected = info.getHeader (Checksum::getHeaderName (checksumType));
+        
+        if (expected.isNotEmpty() && ! expected.containsChar ('-'))
+        {
+            MemoryInputStream in (data, false);
+            return Checksum::calculate (checksumType, in) == expected;
+        }
+    }
+    
+    return info.matchesMD5 (MD5 (data).toHexString());
 }
 
+String AmazonS3::calculateChecksum (Checksum::Type type, const File& file)
+{
+    if (hashIndex != nullptr)
+        return hashIndex->getChecksum (file, type);
+    
+    return Checksum::calculate (type, file);
+}
 
 //==============================================================================
-//==============================================================================
-bool AmazonS3::getObject (S3Object& object, const File& file)
+MemoryMappedFile* AmazonS3::openCachedObject (S3Object& object)
 {
-    object.clearFileAndInfo();
+    // Another thread can evict the body between the lookup and the mapping,
+    // in which case it's fetched again
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        object.clearFileAndInfo();
+        
+        String etag;
+        File body;
+        bool revalidateLater = false;
+        
+        if (objectCache->lookup (object.getBucket(), object.getId(), etag, body))
+        {
+            if (objectCache->isStaleWhileRevalidate())
+                revalidateLater = true;
+            else if (! fetchIntoCache (object, etag))
+                return nullptr;
+        }
+        else if (! fetchIntoCache (object, String::empty))
+        {
+            return nullptr;
+        }
+        
+        if (! revalidateLater && ! objectCache->lookup (object.getBucket(), object.getId(), etag, body))
+            continue;
+        
+        ScopedPointer<MemoryMappedFile> mapped (new MemoryMappedFile (body, MemoryMappedFile::readOnly));
+        
+        // Empty files can't be mapped, but there's nothing to read anyway
+        if (mapped->getData() == nullptr && ! (body.existsAsFile() && body.getSize() == 0))
+            continue;
+        
+        // A 304 doesn't carry the length
+        if (! object.isSuccess())
+            object.setInfo (getCachedInfo (etag, body));
+        
+        // Only once it's mapped, a changed body replaces the old file
+        if (revalidateLater)
+            revalidator->add (object);
+        
+        return mapped.release();
+    }
+    
+    return nullptr;
+}
+
+bool AmazonS3::fetchIntoCache (S3Object& object, const String& cachedETag)
+{
+    String header;
+    String amzHeader;
     
-    S3ObjectInfo objInfo;
+    if (cachedETag.isNotEmpty())
+        header += "--header 'If-None-Match:\"" + cachedETag + "\"' ";
     
-    // We can't get info for sub-elements
-    if (! object.getId().containsChar ('?'))
+    if (checksumType != Checksum::md5)
     {
-        if (! updateObjectInfo (object))
-            return false;
+        header += "--header 'x-amz-checksum-mode:ENABLED' ";
+        amzHeader += "x-amz-checksum-mode:ENABLED\n";
+    }
     
-        objInfo = object.getInfo();
+    const File temp (objectCache->createTemporaryFile());
     
-        if (! objInfo.isSuccess())
-            return false;
+    // Headers on stdout, the body (if there is one) to the temp file
+    S3ObjectInfo info (runCurl (header + "--request GET --dump-header - --output '" +
+                                temp.getFullPathName() + "' " +
+                                "--location '" + createURL ("get", object, amzHeader) + "'"));
+    
+    if (info.getStatus() == 304)
+    {
+        temp.deleteFile();
+        return true;
     }
     
-    String url = createURL ("get", object);
+    object.setInfo (info);
     
-    String result = runCurl ("--request GET --create-dirs --output '" + 
-                             file.getFullPathName() + "' " +
-                             "--location '" + url + "'");
+    if (! info.isSuccess())
+    {
+        temp.deleteFile();
+        
+        if (info.getStatus() == 404)
+            objectCache->remove (object.getBucket(), object.getId());
+        
+        return false;
+    }
     
-    if (result.isNotEmpty())
+    // Temp files mustn't end up in the hash index
+    if (! verifyFile (info, temp, false))
+    {
+        temp.deleteFile();
         return false;
+    }
     
-    // Nothing to match up on sub-element, just try to parse the XML results
-    if (object.getId().containsChar ('?'))
+    if (metadataCache != nullptr)
+        metadataCache->store (object.getBucket(), object.getId(), info);
+    
+    // Kept unzipped, so everything reading from the cache gets the original
+    if (isGzipEncoded (info))
     {
-        object.setInfo (S3ObjectInfo ("HTTP 200 OK"));
-        return true;
+        const File unzipped (objectCache->createTemporaryFile());
+        const bool ok = gunzipFile (temp, unzipped);
+        
+        temp.deleteFile();
+        
+        if (! ok)
+        {
+            unzipped.deleteFile();
+            return false;
+        }
+        
+        return objectCache->store (object.getBucket(), object.getId(), info.getMD5(), unzipped);
     }
     
-    // We can't verify the length and md5 of directory requests, again, just
-    // verify the XML
-    if (! object.getId().length())
-        return true;
+    return objectCache->store (object.getBucket(), object.getId(), info.getMD5(), temp);
+}
+
+//==============================================================================
+String AmazonS3::startMultipartUpload (const S3Object& object, const String& headers,
+                                       const String& amzHeader, const String& contentType)
+{
+    S3Object uploads (object.getBucket(), object.getId() + "?uploads");
     
-    if (file.getSize() != objInfo.getLength())
-        return false;
+    ScopedPointer<XmlElement> xml (XmlDocument::parse (runCurl (headers + "--request POST --location '" +
+                                                                createURL ("post", uploads, amzHeader,
+                                                                           String::empty, String::empty,
+                                                                           contentType) + "'")));
     
-    // Data file request, compare md5
-    MD5 md5 (file);
+    if (xml == nullptr || ! xml->hasTagName ("InitiateMultipartUploadResult"))
+        return String::empty;
     
-    if (md5.toHexString().compareIgnoreCase (objInfo.getMD5()))
-        return false;
+    return xml->getChildElementAllSubText ("UploadId", String::empty).trim();
+}
+
+bool AmazonS3::listUploadedParts (const S3Object& object, const String& uploadId,
+                                  StringArray& etags, StringArray& checksums, bool& uploadExists)
+{
+    S3Object upload (object.getBucket(), object.getId() + "?uploadId=" + uploadId);
+    String marker;
     
-    object.setFile (file);
-    return true;
+    // Only there if the upload was started with an algorithm
+    const String checksumTag (checksumType != Checksum::md5 ? "Checksum" + Checksum::getAlgorithmName (checksumType)
+                                                            : String::empty);
+    
+    etags.clear();
+    checksums.clear();
+    uploadExists = true;
+    
+    // At most 1000 parts a page
+    for (;;)
+    {
+        const String query (marker.isEmpty() ? String::empty : "part-number-marker=" + marker);
+        
+        ScopedPointer<XmlElement> xml (XmlDocument::parse (runCurl ("--request GET --location '" +
+                                                                    createURL ("get", upload, String::empty, query) + "'")));
+        
+        if (xml == nullptr)
+            return false;
+        
+        if (xml->hasTagName ("Error"))
+        {
+            uploadExists = xml->getChildElementAllSubText ("Code", String::empty) != "NoSuchUpload";
+            return false;
+        }
+        
+        if (! xml->hasTagName ("ListPartsResult"))
+            return false;
+        
+        forEachXmlChildElementWithTagName (*xml, part, "Part")
+        {
+            const int partNumber = part->getChildElementAllSubText ("PartNumber", String::empty).getIntValue();
+            const String etag (part->getChildElementAllSubText ("ETag", String::empty).trim().unquoted());
+            
+            if (partNumber < 1 || partNumber > maxParts)
+                continue;
+            
+            while (etags.size() < partNumber)
+            {
+                etags.add (String::empty);
+                checksums.add (String::empty);
+            }
+            
+            etags.set (partNumber - 1, etag);
+            
+            if (checksumTag.isNotEmpty())
+                checksums.set (partNumber - 1, part->getChildElementAllSubText (checksumTag, String::empty).trim());
+        }
+        
+        if (xml->getChildElementAllSubText ("IsTruncated", String::empty) != "true")
+            return true;
+        
+        const String next (xml->getChildElementAllSubText ("NextPartNumberMarker", String::empty).trim());
+        
+        if (next.isEmpty() || next == marker)
+            return false;
+        
+        marker = next;
+    }
 }
 
-bool AmazonS3::putObject (S3Object& object, const File& file, bool makePublic)
+String AmazonS3::uploadPart (const S3Object& object, const String& uploadId, int partNumber,
+                             const File& file, int64 start, int64 length, String& checksum)
 {
-    object.clearFileAndInfo();
+    checksum = String::empty;
     
-    if (! file.exists())
-        return false;
+    FileInputStream in (file);
     
-    String url;
-    String header;
+    if (! (in.openedOk() && in.setPosition (start)))
+        return String::empty;
     
-    if (makePublic)
+    String header, amzHeader;
+    
+    // The CRC goes in a header, ahead of the body, so it takes a read of
+    // its own
+    if (checksumType != Checksum::md5)
     {
-        header = "--header 'x-amz-acl:public-read' ";
-        url = createURL ("put", object, "x-amz-acl:public-read\n");
+        checksum = Checksum::calculate (checksumType, in, length);
+        
+        if (checksum.isEmpty() || ! in.setPosition (start))
+            return String::empty;
+        
+        header = "--header '" + Checksum::getHeaderName (checksumType) + ":" + checksum + "' ";
+        amzHeader = Checksum::getHeaderName (checksumType) + ":" + checksum + "\n";
     }
-    else
+    
+    // Sub-resources go in the id so they're signed, in alphabetical order
+    S3Object part (object.getBucket(), object.getId() + "?partNumber=" + String (partNumber)
+                                                       + "&uploadId=" + uploadId);
+    
+    // curl can only send a whole file, so the part goes in on its stdin
+    PartReader body (in, length);
+    
+    const S3ObjectInfo info (runCurl (header + "--request PUT --dump-header - --upload-file - " +
+                                      "--location '" + createURL ("put", part, amzHeader) + "'", body));
+    
+    // A file that's shrunk since can't fill the part
+    if (body.getPosition() != length)
+        return String::empty;
+    
+    // A part's ETag is the MD5 of its bytes
+    const String md5 (body.getMD5());
+    
+    if (! info.isSuccess() || ! info.matchesMD5 (md5))
+        return String::empty;
+    
+    if (checksum.isNotEmpty() && checksum != info.getHeader (Checksum::getHeaderName (checksumType)))
+        return String::empty;
+    
+    return md5;
+}
+
+bool AmazonS3::completeMultipartUpload (S3Object& object, const String& uploadId, const StringArray& etags,
+                                        const StringArray& checksums)
+{
+    String body ("<CompleteMultipartUpload>");
+    MemoryBlock partDigests;
+    
+    // An upload started with a checksum algorithm needs every part's
+    const String checksumTag ("Checksum" + Checksum::getAlgorithmName (checksumType));
+    
+    for (int i = 0; i < etags.size(); ++i)
     {
-        header = "";
-        url = createURL ("put", object);
+        body << "<Part><PartNumber>" << String (i + 1) << "</PartNumber>"
+             << "<ETag>\"" << etags[i] << "\"</ETag>";
+        
+        if (checksums[i].isNotEmpty())
+            body << "<" << checksumTag << ">" << checksums[i] << "</" << checksumTag << ">";
+        
+        body << "</Part>";
+        
+        MemoryBlock digest;
+        digest.loadFromHexString (etags[i]);
+        partDigests.append (digest.getData(), digest.getSize());
     }
     
-    object.setInfo (S3ObjectInfo (runCurl (header + "--request PUT --dump-header - --upload-file '" +
-                                  file.getFullPathName() + "' " +
-                                  "--location '" + url + "'")));
+    body << "</CompleteMultipartUpload>";
     
-    if (! object.isSuccess())
+    TemporaryFile temp (".xml");
+    
+    if (! temp.getFile().replaceWithText (body))
         return false;
     
-    MD5 md5 (file);
+    S3Object upload (object.getBucket(), object.getId() + "?uploadId=" + uploadId);
     
-    if (md5.toHexString().compareIgnoreCase (object.getInfo().getMD5()))
+    // It can fail after the 200 has gone out, so the body has to be looked at
+    ScopedPointer<XmlElement> xml (XmlDocument::parse (runCurl ("--request POST --upload-file '" +
+                                                                temp.getFile().getFullPathName() + "' " +
+                                                                "--location '" + createURL ("post", upload) + "'")));
+    
+    if (xml == nullptr || ! xml->hasTagName ("CompleteMultipartUploadResult"))
         return false;
-
-    object.setFile (file);
+    
+    // The object's ETag is the MD5 of the parts' MD5s, with the part count
+    const String expected (MD5 (partDigests).toHexString() + "-" + String (etags.size()));
+    const String etag (xml->getChildElementAllSubText ("ETag", String::empty).trim().unquoted());
+    
+    if (! etag.equalsIgnoreCase (expected))
+        return false;
+    
+    object.setInfo (S3ObjectInfo ("HTTP/1.1 200 OK\r\nETag: \"" + etag + "\"\r\n"));
     return true;
 }
 
 //==============================================================================
-bool AmazonS3::getDirectory (const String& bucket, StringArray& list)
+String AmazonS3::copyPart (const S3Object& source, const S3Object& destination, const String& uploadId,
+                           int partNumber, int64 first, int64 last, const String& sourceETag)
 {
-    list.clear();
+    const String copySource (getCopySource (source));
+    const String range ("bytes=" + String (first) + "-" + String (last));
     
-    File temp = File::createTempFile (".xml");
+    // x-amz headers are signed in alphabetical order
+    const String amzHeader ("x-amz-copy-source:" + copySource + "\n" +
+                            "x-amz-copy-source-if-match:" + sourceETag + "\n" +
+                            "x-amz-copy-source-range:" + range + "\n");
     
-    S3Object object (bucket, "");
+    S3Object part (destination.getBucket(), destination.getId() + "?partNumber=" + String (partNumber)
+                                                                 + "&uploadId=" + uploadId);
     
-    if (! getObject (object, temp))
-    {
-        temp.deleteFile();
-        return false;
-    }
+    ScopedPointer<XmlElement> xml (XmlDocument::parse (runCurl ("--header 'x-amz-copy-source:" + copySource + "' " +
+                                                                "--header 'x-amz-copy-source-if-match:" + sourceETag + "' " +
+                                                                "--header 'x-amz-copy-source-range:" + range + "' " +
+                                                                "--request PUT --location '" +
+                                                                createURL ("put", part, amzHeader) + "'")));
     
-    XmlElement* xml = XmlDocument::parse (temp);
-    temp.deleteFile();
+    if (xml == nullptr || ! xml->hasTagName ("CopyPartResult"))
+        return String::empty;
     
-    if (xml != nullptr)
-    {
-        forEachXmlChildElementWithTagName(*xml, c, "Contents")
-        {
-            XmlElement *key = c->getChildByName("Key");
-            if (key)
-                list.add (key->getAllSubText());
-        }
-        
-        delete xml;
-        return true;
-    }
+    const String etag (xml->getChildElementAllSubText ("ETag", String::empty).trim().unquoted());
     
-    return false;
+    return etag.length() == 32 ? etag.toLowerCase() : String::empty;
 }
 
-//==============================================================================
-bool AmazonS3::updateObjectInfo (S3Object& object)
+bool AmazonS3::abortUpload (const S3Object& object, const String& uploadId)
 {
-    object.clearFileAndInfo();
+    S3Object upload (object.getBucket(), object.getId() + "?uploadId=" + uploadId);
+    
+    const S3ObjectInfo info (runCurl ("--request DELETE --dump-header - --location '" +
+                                      createURL ("delete", upload) + "'"));
     
-    object.setInfo (S3ObjectInfo (runCurl ("--head '" + createURL ("head", object) + "'")));
+    // Already gone counts as done
+    return info.isSuccess() || info.getStatus() == 404;
+}
 
-    return object.isSuccess();
+String AmazonS3::getCopySource (const S3Object& object)
+{
+    // Each part of the key escaped, the slashes between them left alone
+    StringArray parts;
+    parts.addTokens (object.getId(), "/", String::empty);
+    
+    for (int i = 0; i < parts.size(); ++i)
+        parts.set (i, URL::addEscapeChars (parts[i], true).replace ("'", "%27"));
+    
+    return "/" + object.getBucket() + "/" + parts.joinIntoString ("/");
+}
+
+void AmazonS3::forgetObject (const String& bucket, const String& key)
+{
+    if (metadataCache != nullptr)
+        metadataCache->remove (bucket, key);
+    
+    if (objectCache != nullptr)
+        objectCache->remove (bucket, key);
+    
+    if (hotCache != nullptr)
+        hotCache->remove (bucket, key);
 }
 
 //==============================================================================
-String AmazonS3::createURL (const String& verb, const S3Object& object, const String& amzHeader)
+String AmazonS3::createURL (const String& verb, const S3Object& object, const String& amzHeader,
+                            const String& query, const String& contentMD5, const String& contentType)
 {
     // Create a signiture
     String expires ((Time::getCurrentTime().toMilliseconds() / 1000) + 300);
     String canonicalizedResource = "/" + object.getBucket() + "/" + object.getId();
 
-    String signString = verb.toUpperCase() + "\n\n\n" + 
+    String signString = verb.toUpperCase() + "\n" + contentMD5 + "\n" + contentType + "\n" + 
                         expires + "\n" +
                         amzHeader +
                         canonicalizedResource;
     
     String signature = URL::addEscapeChars (Base64::encode (HMAC_SHA1::encode (signString, secret)), true);
 
-    // Build up the URL
-    String url;
+    // Build up the URL, sub-resources in the id are signed, the query isn't
+    String url = "https://" + object.getBucket() + ".s3.amazonaws.com/" + object.getId();
     
-    if (! object.getId().containsChar ('?'))
-        url = "https://" + object.getBucket() + ".s3.amazonaws.com/" + object.getId() +
-                 "?AWSAccessKeyId=" + URL::addEscapeChars (credentials, true) +
-                 "&" + "Expires=" + expires + "&Signature=" + signature;
-    else
-        url = "https://" + object.getBucket() + ".s3.amazonaws.com/" + object.getId() +
-        "&AWSAccessKeyId=" + URL::addEscapeChars (credentials, true) +
-        "&" + "Expires=" + expires + "&Signature=" + signature;
+    url += object.getId().containsChar ('?') ? "&" : "?";
+    
+    if (query.isNotEmpty())
+        url += query + "&";
+    
+    url += "AWSAccessKeyId=" + URL::addEscapeChars (credentials, true) +
+           "&" + "Expires=" + expires + "&Signature=" + signature;
         
     return url;
 }
@@ -227,6 +2591,47 @@ String AmazonS3::runCurl (const String& cmdLine)
 {
     String result;
     
+    // Common options go before, redirect after
+    String process = getCurlProcess (cmdLine) + " 2>&1";
+    
+#if JUCE_MAC
+    FILE* pipe = popen (process.toUTF8(), "r");
+    
+    if (pipe)
+    {
+        // Listings can run to megabytes, so it's read in big pieces
+        MemoryOutputStream output;
+        TransferBuffer buffer (65536);
+        size_t numRead;
+        
+        while ((numRead = fread (buffer, 1, buffer.getSize(), pipe)) > 0)
+            output.write (buffer, numRead);
+        
+        pclose (pipe);
+        result = output.toString();
+    }
+#else
+    ChildProcess childProcess;
+    
+    if (childProcess.start (process))
+    {
+        // Listings can run to megabytes, so it's read in big pieces
+        // rather than readAllProcessOutput's 512 bytes
+        MemoryOutputStream output;
+        TransferBuffer buffer (65536);
+        int numRead;
+        
+        while ((numRead = childProcess.readProcessOutput (buffer, (int) buffer.getSize())) > 0)
+            output.write (buffer, numRead);
+        
+        result = output.toString();
+    }
+#endif
+    return result;
+}
+
+String AmazonS3::getCurlProcess (const String& cmdLine)
+{
     String process;
     
 #if JUCE_WINDOWS
@@ -235,27 +2640,96 @@ String AmazonS3::runCurl (const String& cmdLine)
     process = "curl ";
 #endif
     
-    // Add common options before, redirect after
+    // Add common options before
     process += "-q -g -S --remote-time --retry 3 -s ";
     process += cmdLine;
-    process += " 2>&1";
     
-#if JUCE_MAC
-    FILE* pipe = popen(process.toUTF8(), "r");
-    if (pipe)
+    return process;
+}
+
+bool AmazonS3::runCurl (const String& cmdLine, OutputStream& output)
+{
+    // Body only, errors are left on stderr so they can't mix into the data
+    String process = getCurlProcess (cmdLine);
+    
+    TransferBuffer buffer (65536);
+    
+    // A pipe everywhere, as ChildProcess can't say how curl exited, and a
+    // transfer that was cut off mustn't look like it worked
+#if JUCE_WINDOWS
+    FILE* pipe = _popen (process.toUTF8(), "rb");
+#else
+    FILE* pipe = popen (process.toUTF8(), "r");
+#endif
+    
+    if (! pipe)
+        return false;
+    
+    bool written = true;
+    size_t numRead;
+    
+    while ((numRead = fread (buffer, 1, buffer.getSize(), pipe)) > 0)
     {
-        char buffer[128];
-        while (!feof (pipe))
+        if (! output.write (buffer, (int) numRead))
         {
-            if (fgets (buffer, 128, pipe) != NULL)
-                result += buffer;
+            written = false;
+            break;
         }
-        pclose (pipe);
     }
+    
+    // Closing the pipe early stops curl, this waits for it either way
+#if JUCE_WINDOWS
+    const int exitStatus = _pclose (pipe);
 #else
-    ChildProcess childProcess;
-    childProcess.start (process);
-    result = childProcess.readAllProcessOutput();
+    const int exitStatus = pclose (pipe);
 #endif
-    return result;
+    
+    return written && exitStatus == 0;
+}
+
+String AmazonS3::runCurl (const String& cmdLine, InputStream& input)
+{
+#if ! JUCE_WINDOWS
+    // If curl gives up part way, writing to it has to fail rather than
+    // raise a SIGPIPE that ends the whole process
+    signal (SIGPIPE, SIG_IGN);
+#endif
+    
+    // A pipe only goes the one way, so what curl says comes back in a
+    // file, quoted for cmd as well as sh
+    TemporaryFile output (".txt");
+    String process = getCurlProcess (cmdLine) + " > \"" + output.getFile().getFullPathName() + "\" 2>&1";
+    
+#if JUCE_WINDOWS
+    FILE* pipe = _popen (process.toUTF8(), "wb");
+#else
+    FILE* pipe = popen (process.toUTF8(), "w");
+#endif
+    
+    if (! pipe)
+        return String::empty;
+    
+    TransferBuffer buffer (65536);
+    bool written = true;
+    int numRead;
+    
+    while ((numRead = input.read (buffer, (int) buffer.getSize())) > 0)
+    {
+        if (fwrite (buffer, 1, (size_t) numRead, pipe) != (size_t) numRead)
+        {
+            written = false;
+            break;
+        }
+    }
+    
+#if JUCE_WINDOWS
+    const int exitStatus = _pclose (pipe);
+#else
+    const int exitStatus = pclose (pipe);
+#endif
+    
+    if (! written || exitStatus != 0)
+        return String::empty;
+    
+    return output.getFile().loadFileAsString();
 }
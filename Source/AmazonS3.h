@@ -12,36 +12,109 @@
 #define __AMAZONS3_H_CCA7A5D2__
 
 #include "../JuceLibraryCode/JuceHeader.h"
+#include "Checksum.h"
+#include "FileHashIndex.h"
+#include "ListBucketParser.h"
+#include "KeyTable.h"
+#include "ObjectTable.h"
+#include "MetadataCache.h"
+#include "ObjectCache.h"
+#include "HotObjectCache.h"
+#include "BloomFilter.h"
+#include "UploadJournal.h"
 
 //==============================================================================
 //==============================================================================
+/** The result of a request, parsed once from curl's header dump.
+
+    Only what we use is kept: the status, length, last-modified time and the
+    ETag as 16 raw bytes (plus the part count of multipart ETags).  x-amz-*
+    and content headers are kept as extras with pooled names, the rest
+    (dates, request ids etc) are dropped.
+*/
 class S3ObjectInfo
 {
 public:
     //==============================================================================
-    S3ObjectInfo() {}
+    S3ObjectInfo();
     
-    S3ObjectInfo (const String& header_)
-    :  header (header_) {}
+    explicit S3ObjectInfo (const String& header);
     
     ~S3ObjectInfo() {}
     
     //==============================================================================
-    bool isSuccess();
-    bool isValid();
+    bool isSuccess() const      { return status >= 200 && status < 300; }
+    bool isValid() const        { return status > 0; }
+    
+    int getStatus() const       { return status; }
+    String getResult() const;
+    
+    int64 getLength() const     { return length; }
+    
+    // Milliseconds since 1970, 0 if unknown
+    int64 getLastModified() const { return lastModified; }
+    
+    // A PUT response doesn't say how big the object is or when it was written,
+    // these fill that in before it's cached
+    void setLength (int64 newLength)                { length = newLength; }
+    void setLastModified (int64 newLastModified)    { lastModified = newLastModified; }
+    
+    // The ETag as sent, without the quotes.  For a single part upload it's
+    // the hex MD5 of the object, for multipart it's "<md5 of md5s>-<parts>"
+    String getMD5() const;
+    
+    bool hasETag() const                    { return (flags & flagHasETag) != 0; }
+    const uint8* getETagData() const        { return etag; }
+    int getETagPartCount() const            { return etagParts; }
     
-    String getResult();
+    // Binary compare against a hex MD5, false for multipart ETags
+    bool matchesMD5 (const String& md5Hex) const;
     
-    int getLength();
-    String getMD5();
+    // Value of a response header, case-insensitive, empty if missing or not kept
+    String getHeader (const String& name) const;
     
-    String getRawHeader() { return header; }
+    // Lower case names of the headers that were kept: x-amz-*, content-*,
+    // cache-control and expires
+    StringArray getHeaderNames() const;
+    
+    // Rebuilds a header block from what was kept, for logging
+    String toString() const;
+    
+    //==============================================================================
+    // Both return milliseconds since 1970 UTC, or 0 if the text won't parse
+    static int64 parseHttpDate (const String& text);    // "Wed, 12 Oct 2009 17:50:00 GMT"
+    static int64 parseISO8601 (const String& text);     // "2009-10-12T17:50:30.000Z"
+    
+    static bool parseETag (const String& text, uint8* md5, int& parts);
     
     static const S3ObjectInfo empty;
     
 private:
     //==============================================================================
-    String header;
+    class ExtraHeaders  : public ReferenceCountedObject
+    {
+    public:
+        Array<String::CharPointerType> names;
+        StringArray values;
+    };
+    
+    //==============================================================================
+    int64 length;
+    int64 lastModified;
+    uint8 etag[16];
+    int16 status;
+    uint16 etagParts;
+    uint32 flags;
+    String::CharPointerType reason;
+    ReferenceCountedObjectPtr<ExtraHeaders> extras;
+    
+    enum
+    {
+        flagHasETag = 1
+    };
+    
+    void parse (const String& header);
+    void parseLine (const char* line, const char* end);
     
     //==============================================================================
     JUCE_LEAK_DETECTOR(S3ObjectInfo)
@@ -50,6 +123,11 @@ private:
 
 //==============================================================================
 //==============================================================================
+/** A key in a bucket, along with the result of the last request made for it.
+
+    Cheap to make, so each request, or at least each thread, should have its
+    own: the result is simply overwritten by the next call that's given it.
+*/
 class S3Object
 {
 public:
@@ -82,8 +160,8 @@ public:
         lastInfo = S3ObjectInfo();    
     }
     
-    bool isSuccess()   { return lastInfo.isSuccess(); }
-    String getResult() { return lastInfo.getResult(); }
+    bool isSuccess() const   { return lastInfo.isSuccess(); }
+    String getResult() const { return lastInfo.getResult(); }
 
         void clearFileAndInfo() { lastFile = File::nonexistent; lastInfo = S3ObjectInfo::empty; }
     void setFile (const File& file)         { lastFile = file; }
@@ -104,35 +182,234 @@ private:
 
 //==============================================================================
 //==============================================================================
+/** Signs requests and runs them through curl.
+
+    One instance can be shared by any number of threads at once.  Requests
+    keep their state in the S3Object passed in rather than in here, and
+    the optional caches, index and filter do their own locking (mostly
+    sharded), so threads working on different objects rarely wait on each
+    other.  The settings and components below are the exception: set them
+    up before the client is shared, not while requests are running.
+*/
 class AmazonS3
 {
 public:
     //==============================================================================
-    AmazonS3 (const String& credentials_, const String& secret_)
-    :  credentials (credentials_),
-       secret (secret_) {}
-    
-    ~AmazonS3() {}
+    AmazonS3 (const String& credentials_, const String& secret_);
+    ~AmazonS3();
 
+    //==============================================================================
+    // MD5 by default; the CRCs are sent as x-amz-checksum-* headers on put and
+    // requested back with x-amz-checksum-mode on head, so verification never
+    // needs an MD5 pass over the file
+    void setChecksumType (Checksum::Type type) { checksumType = type; }
+    Checksum::Type getChecksumType() const     { return checksumType; }
+    
+    // Off by default.  Puts are gzipped on the way up and sent with
+    // Content-Encoding: gzip, and anything fetched with that encoding is
+    // unzipped again, so local files are always the originals.  ETags,
+    // checksums and listed sizes are of the compressed bytes.
+    void setCompressUploads (bool shouldCompress) { compressUploads = shouldCompress; }
+    bool getCompressUploads() const               { return compressUploads; }
+    
+    // Optional, not owned.  Files that haven't changed since they were last
+    // hashed aren't hashed again, and a put is skipped if the object still has
+    // the ETag recorded when the file was last transferred
+    void setHashIndex (FileHashIndex* index)   { hashIndex = index; }
+    FileHashIndex* getHashIndex() const        { return hashIndex; }
+    
+    // Optional, not owned.  HEADs are answered from the cache while the entry
+    // is live, and successful gets and puts refresh it
+    void setMetadataCache (MetadataCache* cache)   { metadataCache = cache; }
+    MetadataCache* getMetadataCache() const        { return metadataCache; }
+    
+    // Optional, not owned.  Objects are downloaded into the cache and
+    // revalidated with If-None-Match each time they're asked for again
+    void setObjectCache (ObjectCache* cache)       { objectCache = cache; }
+    ObjectCache* getObjectCache() const            { return objectCache; }
+    
+    // Optional, not owned.  Used by readObject() for small objects read over
+    // and over, which are then shared straight out of memory
+    void setHotObjectCache (HotObjectCache* cache) { hotCache = cache; }
+    HotObjectCache* getHotObjectCache() const      { return hotCache; }
+    
+    // Optional, not owned.  Keys it covers and says are missing get a 404
+    // straight away without a HEAD, and our puts are added to it
+    void setBloomFilter (BloomFilter* filter)      { bloomFilter = filter; }
+    BloomFilter* getBloomFilter() const            { return bloomFilter; }
+    
     //==============================================================================
     bool updateObjectInfo (S3Object& object);
     
     bool getObject (S3Object& object, const File& file);
-    bool putObject (S3Object& object, const File& file, bool makePublic = false);
+    
+    // For a key that's just been listed, whose size and ETag stand in for
+    // the HEAD.  If the object has changed since, it's fetched as usual.
+    bool getObject (S3Object& object, const File& file, const ListBucketParser::Entry& listed);
+    
+    // Like getObject, but if the download is cut off the partial file is
+    // kept along with a "<file>.resume" note of the ETag and MD5 state, and
+    // the next call carries on from there with a Range request.  If-Match
+    // makes sure it's still the same object, otherwise it starts again.
+    bool getObjectResumable (S3Object& object, const File& file);
+    
+    // allowCompression false sends the file as it is whatever
+    // setCompressUploads() says, for objects that are read back in ranges
+    bool putObject (S3Object& object, const File& file, bool makePublic = false,
+                    bool allowCompression = true);
+    
+    // Uploads in parts, noting each finished part in the journal file.  If
+    // it's interrupted, calling it again with the same journal asks S3 which
+    // parts it already has and only sends the rest, as long as the file
+    // hasn't changed.  Parts are raised to 5MB or to fit in 10000 parts if
+    // need be, and go up on several threads at once, each read straight
+    // from the file.  The journal is deleted once the upload is complete.
+    //
+    // Each part carries the setChecksumType() checksum for S3 to check.
+    // Parts are byte ranges of the file as it is, so this fails rather
+    // than send anything uncompressed while setCompressUploads() is on.
+    bool putObjectMultipart (S3Object& object, const File& file, const File& journalFile,
+                             int64 partSize = 16 * 1024 * 1024, int numThreads = 4);
+    
+    // Gives up on a journalled upload, so S3 stops keeping its parts
+    bool abortMultipartUpload (const File& journalFile);
+    
+    // Copies on the server, none of the data comes through here.  Objects
+    // over 5GB are copied as a multipart upload with parts copied on several
+    // threads at once.  The source's ETag is checked on every request, so
+    // if it changes part way through the copy fails rather than mixing
+    // versions.  Either way the copy gets the source's Content-Type,
+    // Content-Encoding and other content headers, and its x-amz-meta-*.
+    bool copyObject (const S3Object& source, S3Object& destination, int numThreads = 8);
+    
+    // Succeeds if the key wasn't there either, as S3 doesn't say
+    bool deleteObject (S3Object& object);
+    
+    class DeleteListener
+    {
+    public:
+        virtual ~DeleteListener() {}
+        
+        virtual void objectDeleted (const String& key) = 0;
+        virtual void deleteFailed (const String& key, const String& error) = 0;
+    };
+    
+    // Up to 1000 keys in one multi-object delete request, each key's result
+    // is passed to the listener.  See BatchDelete for any number of keys.
+    bool deleteObjects (const String& bucket, const StringArray& keys, DeleteListener& listener);
+    
+    enum { maxKeysPerDelete = 1000 };
+    
+    // Maps the cached copy of an object, fetching or revalidating it first.
+    // Needs an object cache, the caller deletes the result.  An empty object
+    // comes back with no data, as it can't be mapped.
+    MemoryMappedFile* mapObject (S3Object& object);
+    
+    // An object's contents in memory, from the hot object cache if it's
+    // there, null on failure.  The buffer is shared, don't modify it.
+    HotObjectCache::Buffer::Ptr readObject (S3Object& object);
+    
+    // Part of an object, with a Range header.  False unless exactly that
+    // many bytes came back.
+    bool readRange (S3Object& object, int64 start, int64 numBytes, MemoryBlock& data);
     
     //==============================================================================
-    bool getDirectory (const String& bucket, StringArray& list);
+    struct ListOptions
+    {
+        ListOptions() : maxKeys (1000) {}
+        
+        String prefix;
+        String delimiter;
+        String startAfter;      // only used for the first page
+        int maxKeys;            // S3 caps this at 1000
+    };
+    
+    // Every key in the bucket (or under the prefix), page by page
+    bool getDirectory (const String& bucket, StringArray& list, const String& prefix = String::empty);
+    
+    // The same, packed into a KeyTable, which takes a fraction of the memory
+    // of a StringArray for big listings
+    bool getDirectory (const String& bucket, KeyTable& table, const String& prefix = String::empty);
+    
+    // Keys along with their sizes, ETags and dates, kept column by column
+    bool getDirectory (const String& bucket, ObjectTable& table, const String& prefix = String::empty);
+    
+    // Lists the filter's bucket and prefix into it, and marks it ready
+    bool fillBloomFilter (BloomFilter& filter);
+    
+    // One page of a ListObjectsV2 listing, fed to the parser as it arrives.
+    // Pass an empty token for the first page, then the parser's
+    // getNextContinuationToken() while it isTruncated().  See BucketListing
+    // for an iterator that fetches ahead in the background.
+    bool listObjects (const String& bucket, const ListOptions& options,
+                      const String& continuationToken, ListBucketParser& parser);
     
 private:    
     //==============================================================================
-    String createURL (const String& verb, const S3Object& object, const String& amzHeader = String::empty);
+    String createURL (const String& verb, const S3Object& object, const String& amzHeader = String::empty,
+                      const String& query = String::empty, const String& contentMD5 = String::empty,
+                      const String& contentType = String::empty);
     String runCurl (const String& cmdLine);
+    bool runCurl (const String& cmdLine, OutputStream& output);
+    String runCurl (const String& cmdLine, InputStream& input);
+    bool listAll (const String& bucket, const ListOptions& options, ListBucketParser::Listener& listener);
+    
+    static String getCurlProcess (const String& cmdLine);
+    
+    bool updateObjectInfo (S3Object& object, bool& fromCache);
+    bool downloadObject (S3Object& object, const File& file, const S3ObjectInfo* listedInfo);
+    bool verifyFile (const S3ObjectInfo& info, const File& file, bool useHashIndex = true);
+    bool verifyData (const S3ObjectInfo& info, const MemoryBlock& data);
+    String calculateChecksum (Checksum::Type type, const File& file);
+    
+    MemoryMappedFile* openCachedObject (S3Object& object);
+    bool fetchIntoCache (S3Object& object, const String& cachedETag);
+    
+    // The headers are curl arguments, the x-amz ones among them also
+    // passed as they're signed
+    String startMultipartUpload (const S3Object& object, const String& headers = String::empty,
+                                 const String& amzHeader = String::empty,
+                                 const String& contentType = String::empty);
+    // The checksums are the setChecksumType() ones, empty for md5
+    bool listUploadedParts (const S3Object& object, const String& uploadId,
+                            StringArray& etags, StringArray& checksums, bool& uploadExists);
+    String uploadPart (const S3Object& object, const String& uploadId, int partNumber,
+                       const File& file, int64 start, int64 length, String& checksum);
+    bool completeMultipartUpload (S3Object& object, const String& uploadId, const StringArray& etags,
+                                  const StringArray& checksums = StringArray());
+    
+    bool abortUpload (const S3Object& object, const String& uploadId);
+    String copyPart (const S3Object& source, const S3Object& destination, const String& uploadId,
+                     int partNumber, int64 first, int64 last, const String& sourceETag);
+    static String getCopySource (const S3Object& object);
+    
+    void forgetObject (const String& bucket, const String& key);
     
 private:
     //==============================================================================
     String credentials;
     String secret;
     
+    Checksum::Type checksumType;
+    bool compressUploads;
+    FileHashIndex* hashIndex;
+    MetadataCache* metadataCache;
+    ObjectCache* objectCache;
+    HotObjectCache* hotCache;
+    BloomFilter* bloomFilter;
+    
+    class CacheRevalidator;
+    friend class CacheRevalidator;
+    
+    struct CopyJob;
+    class PartCopier;
+    friend class PartCopier;
+    
+    struct UploadJob;
+    class PartUpload;
+    friend class PartUpload;
+    ScopedPointer<CacheRevalidator> revalidator;
+    
     //==============================================================================
     JUCE_LEAK_DETECTOR (AmazonS3)        
 };
@@ -0,0 +1,122 @@
+/*
+  ==============================================================================
+
+    BatchDelete.cpp
+
+  ==============================================================================
+*/
+
+#include "BatchDelete.h"
+
+
+//==============================================================================
+//==============================================================================
+// Counts the results and passes them on one thread at a time
+class BatchDelete::ResultForwarder  : public AmazonS3::DeleteListener
+{
+public:
+    ResultForwarder (BatchDelete& owner_) : owner (owner_) {}
+
+    void objectDeleted (const String& key)
+    {
+        const ScopedLock sl (owner.listenerLock);
+        ++owner.numDeleted;
+        owner.listener.objectDeleted (key);
+    }
+
+    void deleteFailed (const String& key, const String& error)
+    {
+        const ScopedLock sl (owner.listenerLock);
+        ++owner.numFailed;
+        owner.listener.deleteFailed (key, error);
+    }
+
+private:
+    BatchDelete& owner;
+
+    JUCE_DECLARE_NON_COPYABLE (ResultForwarder);
+};
+
+//==============================================================================
+class BatchDelete::Batch  : public WorkQueue::Job
+{
+public:
+    Batch (BatchDelete& owner_, StringArray* keys_)
+        : owner (owner_), keys (keys_) {}
+
+    void run()      { owner.sendBatch (*keys); }
+
+private:
+    BatchDelete& owner;
+    const ScopedPointer<StringArray> keys;
+
+    JUCE_DECLARE_NON_COPYABLE (Batch);
+};
+
+
+//==============================================================================
+//==============================================================================
+BatchDelete::BatchDelete (AmazonS3& s3_, const String& bucket_,
+                          AmazonS3::DeleteListener& listener_, int numThreads)
+    : s3 (s3_),
+      bucket (bucket_),
+      listener (listener_),
+      queue ("S3 batch delete", numThreads),
+      numDeleted (0),
+      numFailed (0)
+{
+}
+
+BatchDelete::~BatchDelete()
+{
+    finish();
+}
+
+//==============================================================================
+void BatchDelete::add (const String& key)
+{
+    if (current == nullptr)
+        current = new StringArray();
+
+    current->add (key);
+
+    if (current->size() >= AmazonS3::maxKeysPerDelete)
+        queueCurrent();
+}
+
+bool BatchDelete::finish()
+{
+    if (current != nullptr && current->size() > 0)
+        queueCurrent();
+
+    current = nullptr;
+    queue.finish();
+
+    return getNumFailed() == 0;
+}
+
+int BatchDelete::getNumDeleted() const
+{
+    const ScopedLock sl (listenerLock);
+    return numDeleted;
+}
+
+int BatchDelete::getNumFailed() const
+{
+    const ScopedLock sl (listenerLock);
+    return numFailed;
+}
+
+//==============================================================================
+void BatchDelete::queueCurrent()
+{
+    // A couple of batches waiting per thread keeps them busy without
+    // holding millions of keys
+    queue.add (new Batch (*this, current.release()));
+}
+
+void BatchDelete::sendBatch (const StringArray& keys)
+{
+    ResultForwarder forwarder (*this);
+    s3.deleteObjects (bucket, keys, forwarder);
+}
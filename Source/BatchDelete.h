@@ -0,0 +1,83 @@
+/*
+  ==============================================================================
+
+    BatchDelete.h
+
+  ==============================================================================
+*/
+
+#ifndef __BATCHDELETE_H_D1E0A7C6__
+#define __BATCHDELETE_H_D1E0A7C6__
+
+#include "AmazonS3.h"
+#include "WorkQueue.h"
+
+
+//==============================================================================
+//==============================================================================
+/** Deletes any number of keys from a bucket, 1000 to a request.
+
+    Keys are added one at a time, so they can come straight off a listing,
+    and are packed into multi-object deletes which several threads send at
+    once.  Only a few batches are allowed to wait, add() blocks when the
+    threads fall behind, so memory stays flat however many keys there are.
+
+    Each key's result goes to the listener as its batch comes back, from
+    whichever thread sent it, but never from two threads at once.
+
+    @code
+    BatchDelete deleter (s3, "bucket", listener);
+
+    while (listing.next())
+        if (listing.getEntry().lastModified < cutoff)
+            deleter.add (listing.getEntry().key);
+
+    deleter.finish();
+    @endcode
+*/
+class BatchDelete
+{
+public:
+    //==============================================================================
+    BatchDelete (AmazonS3& s3, const String& bucket,
+                 AmazonS3::DeleteListener& listener, int numThreads = 4);
+
+    // Waits for anything still queued
+    ~BatchDelete();
+
+    //==============================================================================
+    void add (const String& key);
+
+    // Sends the last batch and waits for them all, true if every key went
+    bool finish();
+
+    int getNumDeleted() const;
+    int getNumFailed() const;
+
+private:
+    //==============================================================================
+    class Batch;
+    class ResultForwarder;
+    friend class Batch;
+
+    //==============================================================================
+    AmazonS3& s3;
+    const String bucket;
+    AmazonS3::DeleteListener& listener;
+
+    ScopedPointer<StringArray> current;
+    WorkQueue queue;
+    CriticalSection listenerLock;
+
+    int numDeleted, numFailed;
+
+    //==============================================================================
+    void queueCurrent();
+    void sendBatch (const StringArray& keys);
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BatchDelete)
+};
+
+
+#endif  // __BATCHDELETE_H_D1E0A7C6__
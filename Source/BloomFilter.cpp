@@ -0,0 +1,101 @@
+/*
+  ==============================================================================
+
+    BloomFilter.cpp
+
+  ==============================================================================
+*/
+
+#include "BloomFilter.h"
+
+
+//==============================================================================
+//==============================================================================
+BloomFilter::BloomFilter (const String& bucket_, const String& prefix_,
+                          int expectedKeys, double falsePositiveRate)
+    : bucket (bucket_),
+      prefix (prefix_),
+      ready (false)
+{
+    // m = -n ln p / (ln 2)^2 bits and k = m/n ln 2 hashes
+    const double n = jmax (1, expectedKeys);
+    const double p = jlimit (0.000001, 0.5, falsePositiveRate);
+    const double m = jlimit (64.0, 4294967264.0, -n * std::log (p) / 0.4804530139182014);
+
+    numBits = ((uint32) m + 31) & ~(uint32) 31;
+    numHashes = jlimit (1, 16, roundToInt (numBits / n * 0.6931471805599453));
+    bits.calloc (numBits / 32);
+}
+
+BloomFilter::~BloomFilter()
+{
+}
+
+//==============================================================================
+bool BloomFilter::covers (const String& bucket_, const String& key) const
+{
+    return bucket_ == bucket && key.startsWith (prefix);
+}
+
+void BloomFilter::add (const String& key)
+{
+    const uint64 h = hash (key);
+    const uint32 h1 = (uint32) h;
+    const uint32 h2 = (uint32) (h >> 32) | 1;
+
+    const SpinLock::ScopedLockType sl (lock);
+
+    for (int i = 0; i < numHashes; ++i)
+    {
+        const uint32 bit = (h1 + (uint32) i * h2) % numBits;
+        bits [bit >> 5] |= (uint32) 1 << (bit & 31);
+    }
+}
+
+bool BloomFilter::mightContain (const String& key) const
+{
+    const uint64 h = hash (key);
+    const uint32 h1 = (uint32) h;
+    const uint32 h2 = (uint32) (h >> 32) | 1;
+
+    const SpinLock::ScopedLockType sl (lock);
+
+    for (int i = 0; i < numHashes; ++i)
+    {
+        const uint32 bit = (h1 + (uint32) i * h2) % numBits;
+
+        if ((bits [bit >> 5] & ((uint32) 1 << (bit & 31))) == 0)
+            return false;
+    }
+
+    return true;
+}
+
+void BloomFilter::clear()
+{
+    const SpinLock::ScopedLockType sl (lock);
+    zeromem (bits, (numBits / 32) * sizeof (uint32));
+    ready = false;
+}
+
+//==============================================================================
+uint64 BloomFilter::hash (const String& key) noexcept
+{
+    // FNV-1a over the UTF-8, then a finaliser so both halves are usable as
+    // the two hashes of the double hashing scheme
+    uint64 h = 0xcbf29ce484222325ULL;
+
+    for (const char* p = key.toUTF8(); *p != 0; ++p)
+    {
+        h ^= (uint8) *p;
+        h *= 0x100000001b3ULL;
+    }
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
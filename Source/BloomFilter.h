@@ -0,0 +1,72 @@
+/*
+  ==============================================================================
+
+    BloomFilter.h
+
+  ==============================================================================
+*/
+
+#ifndef __BLOOMFILTER_H_C7415D2B__
+#define __BLOOMFILTER_H_C7415D2B__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+
+//==============================================================================
+//==============================================================================
+/** The keys known to exist under one bucket and prefix.
+
+    Filled from a listing (see AmazonS3::fillBloomFilter) and kept up to date
+    with our own puts.  If mightContain() says no, the key definitely wasn't
+    there when we listed and we haven't put it since, so the HEAD can be
+    skipped; a yes can be a false positive and still needs asking about.
+
+    Keys created by anyone else after the listing aren't known about, so
+    refill it now and again if other writers matter.
+*/
+class BloomFilter
+{
+public:
+    //==============================================================================
+    BloomFilter (const String& bucket, const String& prefix,
+                 int expectedKeys, double falsePositiveRate = 0.01);
+
+    ~BloomFilter();
+
+    //==============================================================================
+    const String& getBucket() const     { return bucket; }
+    const String& getPrefix() const     { return prefix; }
+
+    // Only keys under our bucket and prefix can be answered for
+    bool covers (const String& bucket, const String& key) const;
+
+    // Until the first complete fill everything is a maybe
+    bool isReady() const                { return ready; }
+    void setReady (bool isNowReady)     { ready = isNowReady; }
+
+    //==============================================================================
+    void add (const String& key);
+    bool mightContain (const String& key) const;
+
+    void clear();
+
+    int getNumBits() const              { return (int) numBits; }
+    int getNumHashes() const            { return numHashes; }
+
+private:
+    //==============================================================================
+    const String bucket, prefix;
+    uint32 numBits;
+    int numHashes;
+    HeapBlock<uint32> bits;
+    SpinLock lock;
+    bool ready;
+
+    static uint64 hash (const String& key) noexcept;
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BloomFilter)
+};
+
+
+#endif  // __BLOOMFILTER_H_C7415D2B__
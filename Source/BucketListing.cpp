@@ -0,0 +1,180 @@
+/*
+  ==============================================================================
+
+    BucketListing.cpp
+
+  ==============================================================================
+*/
+
+#include "BucketListing.h"
+
+
+//==============================================================================
+//==============================================================================
+class BucketListing::PageCollector  : public ListBucketParser::Listener
+{
+public:
+    PageCollector (Page& page_) : page (page_) {}
+
+    void listEntry (const ListBucketParser::Entry& e)   { page.entries.add (e); }
+    void listCommonPrefix (const String& prefix)        { page.prefixes.add (prefix); }
+
+private:
+    Page& page;
+
+    JUCE_DECLARE_NON_COPYABLE (PageCollector);
+};
+
+
+//==============================================================================
+//==============================================================================
+BucketListing::BucketListing (AmazonS3& s3_, const String& bucket_,
+                              const AmazonS3::ListOptions& options_, int maxPagesAhead_)
+    : Thread ("S3 listing"),
+      s3 (s3_),
+      bucket (bucket_),
+      options (options_),
+      maxPagesAhead (jmax (1, maxPagesAhead_)),
+      finished (false),
+      index (-1),
+      commonPrefix (false)
+{
+    entry.size = 0;
+    entry.lastModified = 0;
+    entry.etagParts = 0;
+    entry.hasETag = false;
+    zerostruct (entry.etag);
+
+    startThread();
+}
+
+BucketListing::~BucketListing()
+{
+    // Lets a page that's in flight finish, curl can't be interrupted cleanly
+    signalThreadShouldExit();
+    notify();
+    stopThread (-1);
+}
+
+//==============================================================================
+bool BucketListing::next()
+{
+    for (;;)
+    {
+        if (currentPage != nullptr)
+        {
+            ++index;
+
+            if (index < currentPage->entries.size())
+            {
+                entry = currentPage->entries.getReference (index);
+                commonPrefix = false;
+                return true;
+            }
+
+            const int prefixIndex = index - currentPage->entries.size();
+
+            if (prefixIndex < currentPage->prefixes.size())
+            {
+                entry.key = currentPage->prefixes[prefixIndex];
+                entry.size = 0;
+                entry.lastModified = 0;
+                entry.etagParts = 0;
+                entry.hasETag = false;
+                commonPrefix = true;
+                return true;
+            }
+
+            currentPage = nullptr;
+        }
+
+        {
+            const ScopedLock sl (lock);
+
+            if (pages.size() > 0)
+            {
+                currentPage = pages.removeAndReturn (0);
+                index = -1;
+
+                // There's room in the queue again
+                notify();
+                continue;
+            }
+
+            if (finished)
+                return false;
+        }
+
+        pageReady.wait();
+    }
+}
+
+//==============================================================================
+bool BucketListing::failed() const
+{
+    const ScopedLock sl (lock);
+    return error.isNotEmpty();
+}
+
+String BucketListing::getError() const
+{
+    const ScopedLock sl (lock);
+    return error;
+}
+
+//==============================================================================
+void BucketListing::run()
+{
+    String continuationToken;
+
+    while (! threadShouldExit())
+    {
+        ScopedPointer<Page> page (new Page());
+        PageCollector collector (*page);
+        ListBucketParser parser (collector);
+
+        const bool ok = s3.listObjects (bucket, options, continuationToken, parser);
+
+        {
+            const ScopedLock sl (lock);
+
+            if (! ok)
+            {
+                error = parser.getErrorCode().isNotEmpty() ? parser.getErrorCode() + ": " + parser.getErrorMessage()
+                                                           : String ("List request failed");
+                finished = true;
+            }
+            else
+            {
+                pages.add (page.release());
+                continuationToken = parser.getNextContinuationToken();
+                finished = ! parser.isTruncated() || continuationToken.isEmpty();
+            }
+        }
+
+        pageReady.signal();
+
+        if (finished)
+            return;
+
+        // Don't run too far ahead of the caller
+        for (;;)
+        {
+            {
+                const ScopedLock sl (lock);
+
+                if (pages.size() < maxPagesAhead)
+                    break;
+            }
+
+            if (threadShouldExit())
+                return;
+
+            wait (-1);
+        }
+    }
+
+    const ScopedLock sl (lock);
+    finished = true;
+    pageReady.signal();
+}
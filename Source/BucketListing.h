@@ -0,0 +1,92 @@
+/*
+  ==============================================================================
+
+    BucketListing.h
+
+  ==============================================================================
+*/
+
+#ifndef __BUCKETLISTING_H_A03E58C7__
+#define __BUCKETLISTING_H_A03E58C7__
+
+#include "AmazonS3.h"
+
+
+//==============================================================================
+//==============================================================================
+/** Walks a bucket listing one entry at a time.
+
+    Pages are fetched on a background thread which keeps up to
+    maxPagesAhead pages queued, so the next page is usually already there
+    by the time the caller finishes with the current one.
+
+    @code
+    BucketListing listing (s3, "bucket", options);
+
+    while (listing.next())
+        DBG (listing.getEntry().key);
+
+    if (listing.failed())
+        DBG (listing.getError());
+    @endcode
+*/
+class BucketListing  : private Thread
+{
+public:
+    //==============================================================================
+    BucketListing (AmazonS3& s3, const String& bucket,
+                   const AmazonS3::ListOptions& options = AmazonS3::ListOptions(),
+                   int maxPagesAhead = 2);
+
+    ~BucketListing();
+
+    //==============================================================================
+    // Moves to the next entry, waiting for a page if need be.  False at the
+    // end of the listing or if a request failed.
+    bool next();
+
+    const ListBucketParser::Entry& getEntry() const     { return entry; }
+
+    // With a delimiter, common prefixes come back as entries too, with the
+    // prefix as the key, after the keys of the page they were in
+    bool isCommonPrefix() const                         { return commonPrefix; }
+
+    bool failed() const;
+    String getError() const;
+
+private:
+    //==============================================================================
+    struct Page
+    {
+        Array<ListBucketParser::Entry> entries;
+        StringArray prefixes;
+    };
+
+    class PageCollector;
+
+    //==============================================================================
+    AmazonS3& s3;
+    const String bucket;
+    const AmazonS3::ListOptions options;
+    const int maxPagesAhead;
+
+    OwnedArray<Page> pages;
+    CriticalSection lock;
+    WaitableEvent pageReady;
+    bool finished;
+    String error;
+
+    ScopedPointer<Page> currentPage;
+    int index;
+    ListBucketParser::Entry entry;
+    bool commonPrefix;
+
+    //==============================================================================
+    void run();
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BucketListing)
+};
+
+
+#endif  // __BUCKETLISTING_H_A03E58C7__
@@ -0,0 +1,467 @@
+/*
+  ==============================================================================
+
+    Checksum.cpp
+
+  ==============================================================================
+*/
+
+/*
+ ======== Check Values ========
+
+ CRC32C ("123456789")    = E3069283
+ CRC64NVME ("123456789") = AE8B14860A799888
+ MD5 ("123456789")       = 25F9E794323B453885F5181F1B624D0B
+*/
+
+#include "Checksum.h"
+#include "Base64.h"
+#include "TransferBufferPool.h"
+
+#if JUCE_INTEL && JUCE_GCC
+ #include <cpuid.h>
+ #include <nmmintrin.h>
+ #define CRC32C_HARDWARE 1
+ #define CRC32C_HARDWARE_TARGET __attribute__ ((target ("sse4.2")))
+#elif JUCE_INTEL && JUCE_MSVC
+ #include <intrin.h>
+ #include <nmmintrin.h>
+ #define CRC32C_HARDWARE 1
+ #define CRC32C_HARDWARE_TARGET
+#else
+ #define CRC32C_HARDWARE 0
+#endif
+
+
+//==============================================================================
+//==============================================================================
+namespace
+{
+    const uint32 crc32cPoly   = 0x82f63b78;               // reflected 0x1EDC6F41
+    const uint64 crc64nvmePoly = 0x9a6c9329ac4bc9b5ULL;   // reflected 0xAD93D23594C93659
+
+    // Slicing-by-8 tables, built once at static init time
+    struct CRCTables
+    {
+        CRCTables()
+        {
+            for (int i = 0; i < 256; ++i)
+            {
+                uint32 c32 = (uint32) i;
+                uint64 c64 = (uint64) i;
+
+                for (int bit = 0; bit < 8; ++bit)
+                {
+                    c32 = (c32 & 1) ? (c32 >> 1) ^ crc32cPoly : (c32 >> 1);
+                    c64 = (c64 & 1) ? (c64 >> 1) ^ crc64nvmePoly : (c64 >> 1);
+                }
+
+                crc32c[0][i] = c32;
+                crc64[0][i] = c64;
+            }
+
+            for (int i = 0; i < 256; ++i)
+            {
+                for (int slice = 1; slice < 8; ++slice)
+                {
+                    crc32c[slice][i] = (crc32c[slice - 1][i] >> 8) ^ crc32c[0][crc32c[slice - 1][i] & 0xff];
+                    crc64[slice][i]  = (crc64[slice - 1][i] >> 8)  ^ crc64[0][crc64[slice - 1][i] & 0xff];
+                }
+            }
+
+           #if CRC32C_HARDWARE
+            hasSSE42 = false;
+
+           #if JUCE_GCC
+            unsigned int a = 0, b = 0, c = 0, d = 0;
+
+            if (__get_cpuid (1, &a, &b, &c, &d))
+                hasSSE42 = (c & bit_SSE4_2) != 0;
+           #else
+            int info[4] = { 0 };
+            __cpuid (info, 1);
+            hasSSE42 = (info[2] & (1 << 20)) != 0;
+           #endif
+           #endif
+        }
+
+        uint32 crc32c[8][256];
+        uint64 crc64[8][256];
+
+       #if CRC32C_HARDWARE
+        bool hasSSE42;
+       #endif
+    };
+
+    const CRCTables tables;
+
+    //==============================================================================
+    uint32 crc32cSoftware (uint32 crc, const uint8* p, size_t numBytes) noexcept
+    {
+        const uint32 (*t)[256] = tables.crc32c;
+
+        while (numBytes > 0 && (((pointer_sized_int) p) & 7) != 0)
+        {
+            crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+            --numBytes;
+        }
+
+        while (numBytes >= 8)
+        {
+            const uint32 lo = ByteOrder::littleEndianInt (p) ^ crc;
+            const uint32 hi = ByteOrder::littleEndianInt (p + 4);
+
+            crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+                ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+
+            p += 8;
+            numBytes -= 8;
+        }
+
+        while (numBytes-- > 0)
+            crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+
+        return crc;
+    }
+
+   #if CRC32C_HARDWARE
+    CRC32C_HARDWARE_TARGET
+    uint32 crc32cHardware (uint32 crc, const uint8* p, size_t numBytes) noexcept
+    {
+        while (numBytes > 0 && (((pointer_sized_int) p) & 7) != 0)
+        {
+            crc = _mm_crc32_u8 (crc, *p++);
+            --numBytes;
+        }
+
+       #if JUCE_64BIT
+        uint64 crc64 = crc;
+
+        while (numBytes >= 8)
+        {
+            crc64 = _mm_crc32_u64 (crc64, *(const uint64*) p);
+            p += 8;
+            numBytes -= 8;
+        }
+
+        crc = (uint32) crc64;
+       #endif
+
+        while (numBytes >= 4)
+        {
+            crc = _mm_crc32_u32 (crc, *(const uint32*) p);
+            p += 4;
+            numBytes -= 4;
+        }
+
+        while (numBytes-- > 0)
+            crc = _mm_crc32_u8 (crc, *p++);
+
+        return crc;
+    }
+   #endif
+
+    //==============================================================================
+    uint64 crc64Software (uint64 crc, const uint8* p, size_t numBytes) noexcept
+    {
+        const uint64 (*t)[256] = tables.crc64;
+
+        while (numBytes > 0 && (((pointer_sized_int) p) & 7) != 0)
+        {
+            crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+            --numBytes;
+        }
+
+        while (numBytes >= 8)
+        {
+            const uint64 x = crc ^ ((uint64) ByteOrder::littleEndianInt (p)
+                                    | ((uint64) ByteOrder::littleEndianInt (p + 4) << 32));
+
+            crc = t[7][x & 0xff]         ^ t[6][(x >> 8) & 0xff]
+                ^ t[5][(x >> 16) & 0xff] ^ t[4][(x >> 24) & 0xff]
+                ^ t[3][(x >> 32) & 0xff] ^ t[2][(x >> 40) & 0xff]
+                ^ t[1][(x >> 48) & 0xff] ^ t[0][x >> 56];
+
+            p += 8;
+            numBytes -= 8;
+        }
+
+        while (numBytes-- > 0)
+            crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+
+        return crc;
+    }
+}
+
+
+//==============================================================================
+//==============================================================================
+void CRC32C::update (const void* data, size_t numBytes) noexcept
+{
+   #if CRC32C_HARDWARE
+    if (tables.hasSSE42)
+    {
+        crc = crc32cHardware (crc, static_cast <const uint8*> (data), numBytes);
+        return;
+    }
+   #endif
+
+    crc = crc32cSoftware (crc, static_cast <const uint8*> (data), numBytes);
+}
+
+String CRC32C::toBase64() const
+{
+    const uint32 value = ByteOrder::swapIfLittleEndian (getValue());
+    return Base64::encode (&value, sizeof (value));
+}
+
+bool CRC32C::isHardwareAccelerated()
+{
+   #if CRC32C_HARDWARE
+    return tables.hasSSE42;
+   #else
+    return false;
+   #endif
+}
+
+//==============================================================================
+//==============================================================================
+void CRC64NVME::update (const void* data, size_t numBytes) noexcept
+{
+    crc = crc64Software (crc, static_cast <const uint8*> (data), numBytes);
+}
+
+String CRC64NVME::toBase64() const
+{
+    const uint64 value = ByteOrder::swapIfLittleEndian (getValue());
+    return Base64::encode (&value, sizeof (value));
+}
+
+
+//==============================================================================
+//==============================================================================
+void ResumableMD5::reset() noexcept
+{
+    state[0] = 0x67452301;
+    state[1] = 0xefcdab89;
+    state[2] = 0x98badcfe;
+    state[3] = 0x10325476;
+    count = 0;
+}
+
+void ResumableMD5::update (const void* data, size_t numBytes) noexcept
+{
+    const uint8* p = static_cast <const uint8*> (data);
+    size_t used = (size_t) (count & 63);
+
+    count += numBytes;
+
+    if (used > 0)
+    {
+        const size_t toCopy = jmin (numBytes, 64 - used);
+        memcpy (buffer + used, p, toCopy);
+        p += toCopy;
+        numBytes -= toCopy;
+
+        if (used + toCopy < 64)
+            return;
+
+        transform (buffer);
+    }
+
+    for (; numBytes >= 64; numBytes -= 64, p += 64)
+        transform (p);
+
+    memcpy (buffer, p, numBytes);
+}
+
+MemoryBlock ResumableMD5::getDigest() const
+{
+    // Padding goes on a copy, so more can still be added afterwards
+    ResumableMD5 final (*this);
+
+    uint8 lengthBits[8];
+    const uint64 bits = count * 8;
+
+    for (int i = 0; i < 8; ++i)
+        lengthBits[i] = (uint8) (bits >> (8 * i));
+
+    static const uint8 padding[64] = { 0x80 };
+    final.update (padding, 1 + ((119 - (size_t) (count & 63)) & 63));
+    final.update (lengthBits, 8);
+
+    uint8 digest[16];
+
+    for (int i = 0; i < 16; ++i)
+        digest[i] = (uint8) (final.state [i >> 2] >> (8 * (i & 3)));
+
+    return MemoryBlock (digest, sizeof (digest));
+}
+
+String ResumableMD5::toHexString() const
+{
+    const MemoryBlock digest (getDigest());
+    return String::toHexString (digest.getData(), (int) digest.getSize(), 0);
+}
+
+//==============================================================================
+MemoryBlock ResumableMD5::getState() const
+{
+    // Little-endian words, the byte count, then the unhashed tail
+    MemoryOutputStream out;
+
+    for (int i = 0; i < 4; ++i)
+        out.writeInt ((int) state[i]);
+
+    out.writeInt64 ((int64) count);
+    out.write (buffer, (int) (count & 63));
+
+    return out.getMemoryBlock();
+}
+
+bool ResumableMD5::setState (const MemoryBlock& newState)
+{
+    if (newState.getSize() < 24)
+        return false;
+
+    MemoryInputStream in (newState, false);
+
+    uint32 words[4];
+
+    for (int i = 0; i < 4; ++i)
+        words[i] = (uint32) in.readInt();
+
+    const uint64 newCount = (uint64) in.readInt64();
+
+    if (newState.getSize() != 24 + (size_t) (newCount & 63))
+        return false;
+
+    memcpy (state, words, sizeof (state));
+    count = newCount;
+    in.read (buffer, (int) (count & 63));
+    return true;
+}
+
+//==============================================================================
+void ResumableMD5::transform (const uint8* block) noexcept
+{
+    static const uint32 k[64] =
+    {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+    };
+
+    static const int shifts[16] = { 7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21 };
+
+    uint32 m[16];
+
+    for (int i = 0; i < 16; ++i)
+        m[i] = ByteOrder::littleEndianInt (block + 4 * i);
+
+    uint32 a = state[0], b = state[1], c = state[2], d = state[3];
+
+    for (int i = 0; i < 64; ++i)
+    {
+        uint32 f;
+        int g;
+
+        switch (i >> 4)
+        {
+            case 0:   f = (b & c) | (~b & d);   g = i;                  break;
+            case 1:   f = (d & b) | (~d & c);   g = (5 * i + 1) & 15;   break;
+            case 2:   f = b ^ c ^ d;            g = (3 * i + 5) & 15;   break;
+            default:  f = c ^ (b | ~d);         g = (7 * i) & 15;       break;
+        }
+
+        const uint32 sum = a + f + k[i] + m[g];
+        const int shift = shifts [((i >> 4) << 2) | (i & 3)];
+
+        a = d;
+        d = c;
+        c = b;
+        b += (sum << shift) | (sum >> (32 - shift));
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+
+//==============================================================================
+//==============================================================================
+String Checksum::getHeaderName (Type type)
+{
+    switch (type)
+    {
+        case crc32c:    return "x-amz-checksum-crc32c";
+        case crc64nvme: return "x-amz-checksum-crc64nvme";
+        default:        break;
+    }
+
+    return String::empty;
+}
+
+String Checksum::getAlgorithmName (Type type)
+{
+    switch (type)
+    {
+        case crc32c:    return "CRC32C";
+        case crc64nvme: return "CRC64NVME";
+        default:        break;
+    }
+
+    return String::empty;
+}
+
+//==============================================================================
+String Checksum::calculate (Type type, const File& file)
+{
+    FileInputStream input (file);
+
+    if (input.failedToOpen())
+        return String::empty;
+
+    return calculate (type, input);
+}
+
+String Checksum::calculate (Type type, InputStream& input, int64 numBytesToRead)
+{
+    if (type == md5)
+        return MD5 (input, numBytesToRead).toHexString();
+
+    CRC32C crc32;
+    CRC64NVME crc64;
+
+    TransferBuffer buffer (1 << 20);
+
+    for (;;)
+    {
+        const int bytesToRead = (int) (numBytesToRead < 0 ? (int64) buffer.getSize() : jmin ((int64) buffer.getSize(), numBytesToRead));
+
+        if (bytesToRead <= 0)
+            break;
+
+        const int bytesRead = input.read (buffer, bytesToRead);
+
+        if (bytesRead <= 0)
+            break;
+
+        if (type == crc32c)
+            crc32.update (buffer, (size_t) bytesRead);
+        else
+            crc64.update (buffer, (size_t) bytesRead);
+
+        if (numBytesToRead >= 0)
+            numBytesToRead -= bytesRead;
+    }
+
+    return type == crc32c ? crc32.toBase64() : crc64.toBase64();
+}
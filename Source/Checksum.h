@@ -0,0 +1,162 @@
+/*
+  ==============================================================================
+
+    Checksum.h
+
+  ==============================================================================
+*/
+
+#ifndef __CHECKSUM_H_4E1B7A90__
+#define __CHECKSUM_H_4E1B7A90__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+
+//==============================================================================
+//==============================================================================
+/** CRC-32C (Castagnoli), as used by S3's x-amz-checksum-crc32c.
+
+    Uses the SSE4.2 crc32 instruction when the CPU has it, otherwise falls
+    back to a slicing-by-8 table implementation.
+*/
+class CRC32C
+{
+public:
+    //==============================================================================
+    CRC32C() noexcept   { reset(); }
+    ~CRC32C() {}
+
+    //==============================================================================
+    void reset() noexcept   { crc = 0xffffffff; }
+
+    void update (const void* data, size_t numBytes) noexcept;
+    void update (const MemoryBlock& data) noexcept  { update (data.getData(), data.getSize()); }
+
+    uint32 getValue() const noexcept    { return ~crc; }
+
+    // Base64 of the big-endian value, as S3 sends it in headers
+    String toBase64() const;
+
+    //==============================================================================
+    static bool isHardwareAccelerated();
+
+private:
+    //==============================================================================
+    uint32 crc;
+
+    //==============================================================================
+    JUCE_LEAK_DETECTOR (CRC32C)
+};
+
+
+//==============================================================================
+//==============================================================================
+/** CRC-64/NVME, as used by S3's x-amz-checksum-crc64nvme.
+
+    Slicing-by-8 table implementation.
+*/
+class CRC64NVME
+{
+public:
+    //==============================================================================
+    CRC64NVME() noexcept    { reset(); }
+    ~CRC64NVME() {}
+
+    //==============================================================================
+    void reset() noexcept   { crc = (uint64) -1; }
+
+    void update (const void* data, size_t numBytes) noexcept;
+    void update (const MemoryBlock& data) noexcept  { update (data.getData(), data.getSize()); }
+
+    uint64 getValue() const noexcept    { return ~crc; }
+
+    // Base64 of the big-endian value, as S3 sends it in headers
+    String toBase64() const;
+
+private:
+    //==============================================================================
+    uint64 crc;
+
+    //==============================================================================
+    JUCE_LEAK_DETECTOR (CRC64NVME)
+};
+
+
+//==============================================================================
+//==============================================================================
+/** MD5 whose running state can be saved and picked up again later.
+
+    JUCE's MD5 only works on a whole block or stream at once; this one is
+    fed piece by piece, and getState()/setState() let a download that was
+    cut off carry on hashing from where it stopped instead of reading back
+    everything it had already written.
+*/
+class ResumableMD5
+{
+public:
+    //==============================================================================
+    ResumableMD5() noexcept     { reset(); }
+    ~ResumableMD5() {}
+
+    //==============================================================================
+    void reset() noexcept;
+
+    void update (const void* data, size_t numBytes) noexcept;
+    void update (const MemoryBlock& data) noexcept  { update (data.getData(), data.getSize()); }
+
+    int64 getNumBytes() const noexcept              { return (int64) count; }
+
+    // The digest of everything so far, the running state isn't touched
+    MemoryBlock getDigest() const;
+    String toHexString() const;
+
+    //==============================================================================
+    // An opaque snapshot, false if it isn't one of ours
+    MemoryBlock getState() const;
+    bool setState (const MemoryBlock& state);
+
+private:
+    //==============================================================================
+    uint32 state[4];
+    uint64 count;
+    uint8 buffer[64];
+
+    void transform (const uint8* block) noexcept;
+
+    //==============================================================================
+    JUCE_LEAK_DETECTOR (ResumableMD5)
+};
+
+
+//==============================================================================
+//==============================================================================
+class Checksum
+{
+public:
+    //==============================================================================
+    enum Type
+    {
+        md5 = 0,
+        crc32c,
+        crc64nvme
+    };
+
+    //==============================================================================
+    // The x-amz-checksum-* header for a type, empty for md5 (which uses the ETag)
+    static String getHeaderName (Type type);
+
+    // The name S3 gives it in x-amz-checksum-algorithm, empty for md5
+    static String getAlgorithmName (Type type);
+
+    // Streams the file once and returns the checksum as S3 would report it,
+    // base64 for the CRCs, hex for md5.  Empty if the file can't be read.
+    static String calculate (Type type, const File& file);
+    static String calculate (Type type, InputStream& input, int64 numBytesToRead = -1);
+
+private:
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Checksum)
+};
+
+
+#endif  // __CHECKSUM_H_4E1B7A90__
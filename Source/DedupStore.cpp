@@ -0,0 +1,327 @@
+/*
+  ==============================================================================
+
+    DedupStore.cpp
+
+  ==============================================================================
+*/
+
+#include "DedupStore.h"
+
+
+//==============================================================================
+//==============================================================================
+namespace
+{
+    // One random 64-bit value per byte value.  These fix where every chunk
+    // is cut, so they must never change once anything has been stored.
+    struct GearTable
+    {
+        GearTable()
+        {
+            // splitmix64, from a fixed seed
+            uint64 state = 0x5333646564757031LL;
+
+            for (int i = 0; i < 256; ++i)
+            {
+                uint64 z = (state += 0x9e3779b97f4a7c15ULL);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                values[i] = z ^ (z >> 31);
+            }
+        }
+
+        uint64 values[256];
+    };
+
+    const GearTable gear;
+
+    // The top bits, which depend on the last 64 bytes rather than the last few
+    uint64 topBitsMask (int numBits)
+    {
+        return ((((uint64) 1) << numBits) - 1) << (64 - numBits);
+    }
+
+    //==============================================================================
+    const char manifestMagic[4] = { 'S', '3', 'D', 'M' };
+    const int manifestVersion = 1;
+}
+
+//==============================================================================
+//==============================================================================
+ContentChunker::ContentChunker (InputStream& source_, int minSize_, int averageSize_, int maxSize_)
+    : source (source_),
+      minSize (jmax (64, minSize_)),
+      averageSize (jmax (minSize, averageSize_)),
+      maxSize (jmax (averageSize, maxSize_)),
+      buffer ((size_t) maxSize * 2),
+      chunkStart (0),
+      chunkSize (0),
+      bufferEnd (0),
+      exhausted (false)
+{
+    int bits = 0;
+
+    while ((1 << (bits + 1)) <= averageSize && bits < 30)
+        ++bits;
+
+    // Harder to cut before the average, easier after it
+    maskSmall = topBitsMask (bits + 2);
+    maskLarge = topBitsMask (jmax (1, bits - 2));
+}
+
+ContentChunker::~ContentChunker()
+{
+}
+
+//==============================================================================
+bool ContentChunker::next()
+{
+    chunkStart += chunkSize;
+    chunkSize = 0;
+
+    // Keeps at least a whole max size chunk ahead, so the buffer is only
+    // shuffled down and topped up about once per max size
+    if (! exhausted && bufferEnd - chunkStart < maxSize)
+    {
+        if (chunkStart > 0)
+        {
+            memmove (buffer, buffer + chunkStart, (size_t) (bufferEnd - chunkStart));
+            bufferEnd -= chunkStart;
+            chunkStart = 0;
+        }
+
+        while (bufferEnd < maxSize * 2)
+        {
+            const int numRead = source.read (buffer + bufferEnd, maxSize * 2 - bufferEnd);
+
+            if (numRead <= 0)
+            {
+                exhausted = true;
+                break;
+            }
+
+            bufferEnd += numRead;
+        }
+    }
+
+    if (chunkStart >= bufferEnd)
+        return false;
+
+    chunkSize = findCutPoint (buffer + chunkStart, bufferEnd - chunkStart);
+    return true;
+}
+
+int ContentChunker::findCutPoint (const uint8* data, int numBytes) const
+{
+    if (numBytes <= minSize)
+        return numBytes;
+
+    const int end = jmin (numBytes, maxSize);
+    const int normal = jmin (end, averageSize);
+
+    uint64 hash = 0;
+    int i = minSize;
+
+    for (; i < normal; ++i)
+    {
+        hash = (hash << 1) + gear.values [data[i]];
+
+        if ((hash & maskSmall) == 0)
+            return i + 1;
+    }
+
+    for (; i < end; ++i)
+    {
+        hash = (hash << 1) + gear.values [data[i]];
+
+        if ((hash & maskLarge) == 0)
+            return i + 1;
+    }
+
+    return end;
+}
+
+
+//==============================================================================
+//==============================================================================
+DedupStore::DedupStore (AmazonS3& s3_, const String& bucket_, const String& prefix_, int numThreads)
+    : s3 (s3_),
+      bucket (bucket_),
+      prefix (prefix_),
+      queue ("S3 dedup upload", numThreads)
+{
+}
+
+DedupStore::~DedupStore()
+{
+    finishUploads();
+}
+
+//==============================================================================
+bool DedupStore::refresh()
+{
+    return s3.getDirectory (bucket, remoteChunks, prefix + "chunks/");
+}
+
+bool DedupStore::putFile (const String& name, const File& file)
+{
+    stats = Stats();
+
+    FileInputStream in (file);
+
+    if (in.failedToOpen())
+        return false;
+
+    const int64 size = in.getTotalLength();
+
+    MemoryOutputStream chunkList;
+    ContentChunker chunker (in);
+
+    while (chunker.next())
+    {
+        const MD5 md5 (chunker.getData(), (size_t) chunker.getSize());
+        const String hex (md5.toHexString());
+
+        chunkList.write (md5.getRawChecksumData().getData(), 16);
+        chunkList.writeInt (chunker.getSize());
+
+        ++stats.numChunks;
+        stats.bytesRead += chunker.getSize();
+
+        // Counted as there as soon as it's queued, so repeats within the
+        // file are only sent once
+        if (! hasChunk (hex))
+        {
+            sentChunks.set (hex, chunker.getSize());
+
+            // Held until it's sent, so it counts against what's in flight.
+            // Chunks can be megabytes each, only a couple per thread wait.
+            TransferBufferPool::getInstance()->waitForRoom (chunker.getSize());
+            queue.add (new Upload (*this, hex, chunker.getData(), chunker.getSize()));
+
+            ++stats.numChunksSent;
+            stats.bytesSent += chunker.getSize();
+        }
+    }
+
+    if (! finishUploads() || stats.bytesRead != size)
+        return false;
+
+    // Only once every chunk is there
+    MemoryOutputStream manifest;
+    manifest.write (manifestMagic, sizeof (manifestMagic));
+    manifest.writeInt (manifestVersion);
+    manifest.writeInt64 (size);
+    manifest.writeInt (stats.numChunks);
+    manifest.write (chunkList.getData(), (int) chunkList.getDataSize());
+
+    TemporaryFile manifestFile (".manifest");
+
+    if (! manifestFile.getFile().replaceWithData (manifest.getData(), manifest.getDataSize()))
+        return false;
+
+    S3Object object (bucket, getManifestKey (name));
+    return s3.putObject (object, manifestFile.getFile());
+}
+
+bool DedupStore::getFile (const String& name, const File& file)
+{
+    S3Object object (bucket, getManifestKey (name));
+    HotObjectCache::Buffer::Ptr manifest (s3.readObject (object));
+
+    if (manifest == nullptr || manifest->getSize() < sizeof (manifestMagic) + 16
+         || memcmp (manifest->getData(), manifestMagic, sizeof (manifestMagic)) != 0)
+        return false;
+
+    MemoryInputStream in (manifest->getData(), manifest->getSize(), false);
+    in.skipNextBytes (sizeof (manifestMagic));
+
+    if (in.readInt() != manifestVersion)
+        return false;
+
+    const int64 size = in.readInt64();
+    const int numChunks = in.readInt();
+
+    if (numChunks < 0 || in.getNumBytesRemaining() != (int64) numChunks * 20)
+        return false;
+
+    TemporaryFile temp (file);
+    int64 written = 0;
+
+    {
+        FileOutputStream out (temp.getFile());
+
+        if (out.failedToOpen())
+            return false;
+
+        for (int i = 0; i < numChunks; ++i)
+        {
+            MemoryBlock md5;
+            in.readIntoMemoryBlock (md5, 16);
+            const int chunkSize = in.readInt();
+
+            S3Object chunk (bucket, getChunkKey (String::toHexString (md5.getData(), 16, 0)));
+            HotObjectCache::Buffer::Ptr data (s3.readObject (chunk));
+
+            if (data == nullptr || (int) data->getSize() != chunkSize
+                 || MD5 (data->getData(), data->getSize()).getRawChecksumData() != md5)
+                return false;
+
+            if (! out.write (data->getData(), chunkSize))
+                return false;
+
+            written += chunkSize;
+        }
+
+        out.flush();
+
+        if (! out.getStatus().wasOk())
+            return false;
+    }
+
+    return written == size && temp.overwriteTargetFileWithTemporary();
+}
+
+//==============================================================================
+String DedupStore::getChunkKey (const String& md5) const
+{
+    return prefix + "chunks/" + md5;
+}
+
+String DedupStore::getManifestKey (const String& name) const
+{
+    return prefix + "manifests/" + name;
+}
+
+bool DedupStore::hasChunk (const String& md5) const
+{
+    return sentChunks.contains (md5) || remoteChunks.contains (getChunkKey (md5));
+}
+
+//==============================================================================
+bool DedupStore::finishUploads()
+{
+    queue.finish();
+
+    // Whatever didn't go has to be tried again next time
+    for (int i = 0; i < failedChunks.size(); ++i)
+        sentChunks.remove (failedChunks[i]);
+
+    const bool ok = failedChunks.size() == 0;
+    failedChunks.clear();
+    return ok;
+}
+
+void DedupStore::sendUpload (Upload& upload)
+{
+    TemporaryFile temp (".chunk");
+    S3Object object (bucket, getChunkKey (upload.md5));
+
+    if (temp.getFile().replaceWithData (upload.data, (size_t) upload.size)
+         && s3.putObject (object, temp.getFile()))
+        return;
+
+    const ScopedLock sl (lock);
+    failedChunks.add (upload.md5);
+}
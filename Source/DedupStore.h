@@ -0,0 +1,165 @@
+/*
+  ==============================================================================
+
+    DedupStore.h
+
+  ==============================================================================
+*/
+
+#ifndef __DEDUPSTORE_H_2C7F45B1__
+#define __DEDUPSTORE_H_2C7F45B1__
+
+#include "AmazonS3.h"
+#include "KeyTable.h"
+#include "TransferBufferPool.h"
+#include "WorkQueue.h"
+
+
+//==============================================================================
+//==============================================================================
+/** Cuts a stream into chunks wherever its content says to.
+
+    A gear hash is rolled over the bytes and a chunk ends where its top bits
+    are all zero, so the cut points move with the data: an insert near the
+    start of a file changes the chunk it lands in and leaves the rest alone.
+    As in FastCDC the first minSize bytes of each chunk aren't looked at,
+    and a stricter mask is used before averageSize than after it, which
+    keeps chunk sizes close to the average.
+*/
+class ContentChunker
+{
+public:
+    //==============================================================================
+    ContentChunker (InputStream& source,
+                    int minSize = 256 * 1024,
+                    int averageSize = 1024 * 1024,
+                    int maxSize = 8 * 1024 * 1024);
+
+    ~ContentChunker();
+
+    //==============================================================================
+    // Moves on to the next chunk, false at the end of the stream
+    bool next();
+
+    // Valid until the next call to next()
+    const void* getData() const     { return buffer + chunkStart; }
+    int getSize() const             { return chunkSize; }
+
+private:
+    //==============================================================================
+    InputStream& source;
+    const int minSize, averageSize, maxSize;
+    uint64 maskSmall, maskLarge;
+
+    HeapBlock<uint8> buffer;
+    int chunkStart, chunkSize, bufferEnd;
+    bool exhausted;
+
+    //==============================================================================
+    int findCutPoint (const uint8* data, int numBytes) const;
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ContentChunker)
+};
+
+
+//==============================================================================
+//==============================================================================
+/** Stores files as content-addressed chunks, each one only once.
+
+    Chunks go under "<prefix>chunks/", named by their MD5, and each file
+    under "<prefix>manifests/<name>" as the list of its chunks.  A put only
+    sends the chunks that the bucket doesn't have yet, so a file that's
+    mostly the same as one put before costs little more than its changes.
+    The manifest is put last, so if it's there every chunk it lists is too.
+
+    refresh() lists the chunks already in the bucket, call it once before
+    putting anything; chunks put since are remembered as they go.
+
+    @code
+    DedupStore store (s3, "bucket", "snapshots/");
+
+    if (store.refresh())
+        store.putFile ("db-" + today, dumpFile);
+    @endcode
+*/
+class DedupStore
+{
+public:
+    //==============================================================================
+    DedupStore (AmazonS3& s3, const String& bucket, const String& prefix, int numThreads = 4);
+    ~DedupStore();
+
+    //==============================================================================
+    bool refresh();
+
+    // New chunks are put by several threads at once.  If the
+    // TransferBufferPool has a limit, reading waits while it's reached.
+    bool putFile (const String& name, const File& file);
+
+    // Each chunk is checked against its name as it's read
+    bool getFile (const String& name, const File& file);
+
+    //==============================================================================
+    // For the last putFile
+    struct Stats
+    {
+        Stats() : numChunks (0), numChunksSent (0), bytesRead (0), bytesSent (0) {}
+
+        int numChunks, numChunksSent;
+        int64 bytesRead, bytesSent;
+    };
+
+    Stats getStats() const          { return stats; }
+
+private:
+    //==============================================================================
+    class Upload  : public WorkQueue::Job
+    {
+    public:
+        Upload (DedupStore& owner_, const String& md5_, const void* source, int size_)
+            : owner (owner_), md5 (md5_), data ((size_t) size_), size (size_)
+        {
+            memcpy (data, source, (size_t) size);
+        }
+
+        void run()      { owner.sendUpload (*this); }
+
+        DedupStore& owner;
+        const String md5;
+        TransferBuffer data;
+        const int size;
+
+    private:
+        JUCE_DECLARE_NON_COPYABLE (Upload);
+    };
+
+    friend class Upload;
+
+    //==============================================================================
+    AmazonS3& s3;
+    const String bucket, prefix;
+
+    KeyTable remoteChunks;
+    HashMap<String, int> sentChunks;
+
+    WorkQueue queue;
+    StringArray failedChunks;
+    CriticalSection lock;
+
+    Stats stats;
+
+    //==============================================================================
+    String getChunkKey (const String& md5) const;
+    String getManifestKey (const String& name) const;
+
+    bool hasChunk (const String& md5) const;
+    bool finishUploads();
+    void sendUpload (Upload& upload);
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DedupStore)
+};
+
+
+#endif  // __DEDUPSTORE_H_2C7F45B1__
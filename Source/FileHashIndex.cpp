@@ -0,0 +1,417 @@
+/*
+  ==============================================================================
+
+    FileHashIndex.cpp
+
+  ==============================================================================
+*/
+
+#include "FileHashIndex.h"
+#include "Base64.h"
+
+#if ! JUCE_WINDOWS
+ #include <sys/stat.h>
+#endif
+
+
+//==============================================================================
+//==============================================================================
+namespace
+{
+    struct IndexHeader
+    {
+        char   magic[4];
+        uint32 version;
+        uint64 numRecords;
+    };
+
+    const char indexMagic[4] = { 'S', '3', 'H', 'I' };
+    const uint32 indexVersion = 1;
+
+    // A multipart ETag's part count is kept in the flags, above the bits
+    // that are used
+    const int etagPartsShift = 16;
+
+    //==============================================================================
+    struct RecordComparator
+    {
+        static int compareElements (const FileHashIndex::Record& a, const FileHashIndex::Record& b) noexcept
+        {
+            return a.pathHash < b.pathHash ? -1 : (a.pathHash > b.pathHash ? 1 : 0);
+        }
+    };
+
+    bool isSameFile (const FileHashIndex::Record& a, const FileHashIndex::Record& b) noexcept
+    {
+        return a.size == b.size
+            && a.modified == b.modified
+            && a.inode == b.inode;
+    }
+
+    //==============================================================================
+    bool parseHex16 (const String& hex, uint8* dest)
+    {
+        if (hex.length() != 32 || ! hex.containsOnly ("0123456789abcdefABCDEF"))
+            return false;
+
+        MemoryBlock data;
+        data.loadFromHexString (hex);
+
+        if (data.getSize() != 16)
+            return false;
+
+        memcpy (dest, data.getData(), 16);
+        return true;
+    }
+
+    bool parseBase64 (const String& base64, uint64& value, size_t numBytes)
+    {
+        MemoryBlock data = Base64::decode (base64);
+
+        if (data.getSize() != numBytes)
+            return false;
+
+        value = 0;
+
+        for (size_t i = 0; i < numBytes; ++i)
+            value = (value << 8) | (uint8) data[i];
+
+        return true;
+    }
+
+    String toBase64 (uint64 value, size_t numBytes)
+    {
+        uint8 data[8];
+
+        for (size_t i = numBytes; i-- > 0;)
+        {
+            data[i] = (uint8) value;
+            value >>= 8;
+        }
+
+        return Base64::encode (data, numBytes);
+    }
+}
+
+
+//==============================================================================
+//==============================================================================
+FileHashIndex::FileHashIndex (const File& indexFile_)
+    : indexFile (indexFile_),
+      mappedRecords (nullptr),
+      numMappedRecords (0),
+      pending (4096)
+{
+    openIndex();
+}
+
+FileHashIndex::~FileHashIndex()
+{
+    save();
+}
+
+//==============================================================================
+String FileHashIndex::getChecksum (const File& file, Checksum::Type type)
+{
+    Record current;
+
+    if (! statFile (file, current))
+        return String::empty;
+
+    {
+        const ScopedLock sl (lock);
+
+        Record known;
+
+        if (findRecord (current.pathHash, known) && isSameFile (known, current))
+        {
+            if (type == Checksum::md5 && (known.flags & hasMD5) != 0)
+                return String::toHexString (known.md5, 16, 0);
+
+            if (type == Checksum::crc32c && (known.flags & hasCRC32C) != 0)
+                return toBase64 (known.crc32c, 4);
+
+            if (type == Checksum::crc64nvme && (known.flags & hasCRC64NVME) != 0)
+                return toBase64 (known.crc64nvme, 8);
+        }
+    }
+
+    // Hash outside the lock so other threads aren't held up by the disk
+    String checksum = Checksum::calculate (type, file);
+
+    // Don't record it if the file changed underneath us
+    Record after;
+
+    if (checksum.isEmpty() || ! statFile (file, after) || ! isSameFile (after, current))
+        return checksum;
+
+    const ScopedLock sl (lock);
+
+    Record record;
+
+    if (! findRecord (current.pathHash, record) || ! isSameFile (record, current))
+        record = current;
+
+    bool ok = false;
+
+    if (type == Checksum::md5)
+    {
+        ok = parseHex16 (checksum, record.md5);
+        record.flags |= ok ? hasMD5 : 0;
+    }
+    else if (type == Checksum::crc32c)
+    {
+        uint64 value = 0;
+        ok = parseBase64 (checksum, value, 4);
+        record.crc32c = (uint32) value;
+        record.flags |= ok ? hasCRC32C : 0;
+    }
+    else
+    {
+        ok = parseBase64 (checksum, record.crc64nvme, 8);
+        record.flags |= ok ? hasCRC64NVME : 0;
+    }
+
+    if (ok)
+        pending.set (record.pathHash, record);
+
+    return checksum;
+}
+
+//==============================================================================
+String FileHashIndex::getRemoteETag (const File& file)
+{
+    Record current;
+
+    if (! statFile (file, current))
+        return String::empty;
+
+    const ScopedLock sl (lock);
+
+    Record known;
+
+    if (findRecord (current.pathHash, known) && isSameFile (known, current) && (known.flags & hasETag) != 0)
+    {
+        String etag (String::toHexString (known.etag, 16, 0));
+        const int numParts = (int) (known.flags >> etagPartsShift);
+
+        if (numParts > 0)
+            etag << '-' << numParts;
+
+        return etag;
+    }
+
+    return String::empty;
+}
+
+void FileHashIndex::setRemoteETag (const File& file, const String& etag)
+{
+    Record current;
+
+    if (! statFile (file, current))
+        return;
+
+    const ScopedLock sl (lock);
+
+    Record record;
+
+    if (! findRecord (current.pathHash, record) || ! isSameFile (record, current))
+        record = current;
+
+    // Multipart ETags are "xxx-N", the MD5 of the parts' MD5s and a count
+    const String value (etag.unquoted());
+    const int numParts = value.fromFirstOccurrenceOf ("-", false, false).getIntValue();
+
+    record.flags &= (1u << etagPartsShift) - 1;
+    record.flags &= ~(uint32) hasETag;
+
+    if (parseHex16 (value.upToFirstOccurrenceOf ("-", false, false), record.etag)
+         && (! value.containsChar ('-') || (numParts > 0 && numParts <= 0xffff)))
+        record.flags |= hasETag | ((uint32) numParts << etagPartsShift);
+
+    pending.set (record.pathHash, record);
+}
+
+//==============================================================================
+bool FileHashIndex::save()
+{
+    const ScopedLock sl (lock);
+
+    if (pending.size() == 0)
+        return true;
+
+    Array<Record> updates;
+    updates.ensureStorageAllocated (pending.size());
+
+    HashMap<uint64, Record, PathHash>::Iterator i (pending);
+
+    while (i.next())
+        updates.add (i.getValue());
+
+    RecordComparator comparator;
+    updates.sort (comparator);
+
+    TemporaryFile temp (indexFile);
+
+    {
+        ScopedPointer<FileOutputStream> out (temp.getFile().createOutputStream());
+
+        if (out == nullptr)
+            return false;
+
+        IndexHeader header;
+        memcpy (header.magic, indexMagic, sizeof (indexMagic));
+        header.version = indexVersion;
+        header.numRecords = 0;
+
+        out->write (&header, sizeof (header));
+
+        // Merge the sorted pending records over the sorted mapped ones
+        int m = 0, u = 0;
+
+        while (m < numMappedRecords || u < updates.size())
+        {
+            const Record* next;
+
+            if (u >= updates.size())
+                next = mappedRecords + m++;
+            else if (m >= numMappedRecords || updates.getReference (u).pathHash < mappedRecords[m].pathHash)
+                next = &updates.getReference (u++);
+            else if (updates.getReference (u).pathHash == mappedRecords[m].pathHash)
+            {
+                next = &updates.getReference (u++);
+                m++;
+            }
+            else
+                next = mappedRecords + m++;
+
+            out->write (next, sizeof (Record));
+            header.numRecords++;
+        }
+
+        out->setPosition (0);
+        out->write (&header, sizeof (header));
+        out->flush();
+
+        if (out->getStatus().failed())
+            return false;
+    }
+
+    // Let go of the old mapping before it gets replaced
+    mappedFile = nullptr;
+    mappedRecords = nullptr;
+    numMappedRecords = 0;
+
+    const bool ok = temp.overwriteTargetFileWithTemporary();
+
+    if (ok)
+        pending.clear();
+
+    openIndex();
+    return ok;
+}
+
+//==============================================================================
+void FileHashIndex::openIndex()
+{
+    mappedFile = nullptr;
+    mappedRecords = nullptr;
+    numMappedRecords = 0;
+
+    if (! indexFile.existsAsFile())
+        return;
+
+    mappedFile = new MemoryMappedFile (indexFile, MemoryMappedFile::readOnly);
+
+    const IndexHeader* header = static_cast <const IndexHeader*> (mappedFile->getData());
+
+    // A damaged or foreign index is just ignored, it'll be rewritten on save
+    if (header == nullptr
+         || mappedFile->getSize() < sizeof (IndexHeader)
+         || memcmp (header->magic, indexMagic, sizeof (indexMagic)) != 0
+         || header->version != indexVersion
+         || mappedFile->getSize() != sizeof (IndexHeader) + header->numRecords * sizeof (Record))
+    {
+        mappedFile = nullptr;
+        return;
+    }
+
+    mappedRecords = reinterpret_cast <const Record*> (header + 1);
+    numMappedRecords = (int) header->numRecords;
+}
+
+bool FileHashIndex::findRecord (uint64 pathHash, Record& record)
+{
+    if (pending.contains (pathHash))
+    {
+        record = pending [pathHash];
+        return true;
+    }
+
+    int start = 0;
+    int end = numMappedRecords;
+
+    while (start < end)
+    {
+        const int mid = start + (end - start) / 2;
+
+        if (mappedRecords[mid].pathHash < pathHash)
+            start = mid + 1;
+        else
+            end = mid;
+    }
+
+    if (start < numMappedRecords && mappedRecords[start].pathHash == pathHash)
+    {
+        record = mappedRecords[start];
+        return true;
+    }
+
+    return false;
+}
+
+bool FileHashIndex::statFile (const File& file, Record& record)
+{
+    zerostruct (record);
+
+    record.pathHash = hashPath (file.getFullPathName());
+
+   #if JUCE_WINDOWS
+    if (! file.existsAsFile())
+        return false;
+
+    record.size = file.getSize();
+    record.modified = file.getLastModificationTime().toMilliseconds();
+   #else
+    struct stat info;
+
+    if (stat (file.getFullPathName().toUTF8(), &info) != 0 || ! S_ISREG (info.st_mode))
+        return false;
+
+    record.size = (int64) info.st_size;
+    record.inode = (uint64) info.st_ino;
+
+   #if JUCE_MAC || JUCE_IOS
+    record.modified = (int64) info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+   #else
+    record.modified = (int64) info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+   #endif
+   #endif
+
+    return true;
+}
+
+//==============================================================================
+uint64 FileHashIndex::hashPath (const String& path)
+{
+    // 64 bit FNV-1a
+    uint64 hash = 0xcbf29ce484222325ULL;
+
+    for (const char* p = path.toUTF8(); *p != 0; ++p)
+    {
+        hash ^= (uint8) *p;
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
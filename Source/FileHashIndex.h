@@ -0,0 +1,100 @@
+/*
+  ==============================================================================
+
+    FileHashIndex.h
+
+  ==============================================================================
+*/
+
+#ifndef __FILEHASHINDEX_H_91C3F2D4__
+#define __FILEHASHINDEX_H_91C3F2D4__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "Checksum.h"
+
+
+//==============================================================================
+//==============================================================================
+/** Persistent cache of file checksums, keyed on (path, size, mtime, inode).
+
+    A file whose stat matches its record is assumed unchanged, so its MD5/CRC
+    comes back without reading it again.  The last ETag seen for it on S3 is
+    kept alongside.
+
+    On disk the index is a header followed by fixed size records sorted on a
+    64 bit hash of the path, read through a MemoryMappedFile and binary
+    searched.  New records are held in memory until save().
+*/
+class FileHashIndex
+{
+public:
+    //==============================================================================
+    explicit FileHashIndex (const File& indexFile);
+
+    // Saves any pending changes
+    ~FileHashIndex();
+
+    //==============================================================================
+    // The checksum of the file in Checksum::calculate's format, taken from the
+    // index if the file hasn't changed, otherwise calculated and recorded
+    String getChecksum (const File& file, Checksum::Type type);
+
+    // The ETag last recorded for this file, empty if none or the file has
+    // changed since.  Multipart ETags keep their "-N".
+    String getRemoteETag (const File& file);
+    void setRemoteETag (const File& file, const String& etag);
+
+    //==============================================================================
+    bool save();
+
+    //==============================================================================
+    enum
+    {
+        hasMD5       = 1,
+        hasCRC32C    = 2,
+        hasCRC64NVME = 4,
+        hasETag      = 8
+    };
+
+    // Exactly as laid out on disk
+    struct Record
+    {
+        uint64 pathHash;
+        int64  size;
+        int64  modified;
+        uint64 inode;
+        uint64 crc64nvme;
+        uint32 crc32c;
+        uint32 flags;
+        uint8  md5[16];
+        uint8  etag[16];
+    };
+
+private:
+    //==============================================================================
+    struct PathHash
+    {
+        static int generateHash (const uint64 key, const int upperLimit) noexcept   { return (int) (key % (uint64) upperLimit); }
+    };
+
+    File indexFile;
+    ScopedPointer<MemoryMappedFile> mappedFile;
+    const Record* mappedRecords;
+    int numMappedRecords;
+
+    HashMap<uint64, Record, PathHash> pending;
+    CriticalSection lock;
+
+    //==============================================================================
+    void openIndex();
+    bool findRecord (uint64 pathHash, Record& record);
+    bool statFile (const File& file, Record& record);
+
+    static uint64 hashPath (const String& path);
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FileHashIndex)
+};
+
+
+#endif  // __FILEHASHINDEX_H_91C3F2D4__
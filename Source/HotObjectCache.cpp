@@ -0,0 +1,421 @@
+/*
+  ==============================================================================
+
+    HotObjectCache.cpp
+
+  ==============================================================================
+*/
+
+#include "HotObjectCache.h"
+
+
+//==============================================================================
+//==============================================================================
+struct HotObjectCache::Entry
+{
+    Entry() : hash (0), expires (0), bytes (0), previous (this), next (this), sameHash (nullptr) {}
+
+    void unlink()
+    {
+        previous->next = next;
+        next->previous = previous;
+        previous = next = this;
+    }
+
+    void insertAfter (Entry* other)
+    {
+        previous = other;
+        next = other->next;
+        other->next->previous = this;
+        other->next = this;
+    }
+
+    bool matches (const String& bucket_, const String& key_) const
+    {
+        return key == key_ && bucket == bucket_;
+    }
+
+    String bucket, key;
+    int hash;
+    Buffer::Ptr buffer;
+    uint32 expires;
+    int64 bytes;
+    Entry* previous;
+    Entry* next;
+    Entry* sameHash;
+};
+
+//==============================================================================
+// Entries taken out under a shard's lock.  It's declared before the lock is
+// taken, so they and their buffers are deleted once it's been let go.
+class HotObjectCache::Graveyard
+{
+public:
+    Graveyard() : first (nullptr) {}
+
+    ~Graveyard()
+    {
+        while (first != nullptr)
+        {
+            Entry* const entry = first;
+            first = entry->next;
+            delete entry;
+        }
+    }
+
+    void add (Entry* entry)
+    {
+        entry->next = first;
+        first = entry;
+    }
+
+private:
+    Entry* first;
+
+    JUCE_DECLARE_NON_COPYABLE (Graveyard);
+};
+
+//==============================================================================
+// Four rows of 4-bit counters (kept in bytes), halved every so often so old
+// popularity fades
+class HotObjectCache::FrequencySketch
+{
+public:
+    FrequencySketch (int width)
+        : mask ((uint32) nextPowerOfTwo (jlimit (64, 1 << 20, width)) - 1),
+          counters (4 * (mask + 1), true),
+          additions (0),
+          sampleSize (10 * (int) (mask + 1))
+    {
+    }
+
+    void increment (int hash)
+    {
+        bool added = false;
+
+        for (int row = 0; row < 4; ++row)
+        {
+            uint8& counter = counters [getIndex (hash, row)];
+
+            if (counter < 15)
+            {
+                ++counter;
+                added = true;
+            }
+        }
+
+        if (added && ++additions >= sampleSize)
+            halve();
+    }
+
+    int getFrequency (int hash) const
+    {
+        int frequency = 15;
+
+        for (int row = 0; row < 4; ++row)
+            frequency = jmin (frequency, (int) counters [getIndex (hash, row)]);
+
+        return frequency;
+    }
+
+private:
+    const uint32 mask;
+    HeapBlock<uint8> counters;
+    int additions;
+    const int sampleSize;
+
+    size_t getIndex (int hash, int row) const noexcept
+    {
+        static const uint32 seeds[] = { 0x97cb3127, 0xb2f1a8e5, 0x61c88647, 0x2545f491 };
+
+        uint32 h = ((uint32) hash + seeds[row]) * 0x9e3779b1;
+        h ^= h >> 16;
+
+        return (size_t) row * (mask + 1) + (h & mask);
+    }
+
+    void halve()
+    {
+        for (size_t i = 0; i < 4 * (size_t) (mask + 1); ++i)
+            counters[i] >>= 1;
+
+        additions /= 2;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (FrequencySketch);
+};
+
+//==============================================================================
+class HotObjectCache::Shard
+{
+public:
+    Shard (int64 maxBytes_)
+        : sketch ((int) jmin ((int64) (1 << 20), maxBytes_ / 512)),
+          bytes (0),
+          maxBytes (maxBytes_),
+          numEntries (0)
+    {
+    }
+
+    ~Shard()
+    {
+        Graveyard dead;
+        clear (dead);
+    }
+
+    // Entries with the same hash are chained, so nothing has to be built
+    // to look one up
+    Entry* find (int hash, const String& bucket, const String& key) const
+    {
+        for (Entry* entry = entries [(uint32) hash]; entry != nullptr; entry = entry->sameHash)
+            if (entry->matches (bucket, key))
+                return entry;
+
+        return nullptr;
+    }
+
+    void moveToFront (Entry* entry)
+    {
+        entry->unlink();
+        entry->insertAfter (&lru);
+    }
+
+    void add (Entry* entry)
+    {
+        entry->sameHash = entries [(uint32) entry->hash];
+        entries.set ((uint32) entry->hash, entry);
+        bytes += entry->bytes;
+        ++numEntries;
+        entry->insertAfter (&lru);
+    }
+
+    void remove (Entry* entry, Graveyard& dead)
+    {
+        Entry* const first = entries [(uint32) entry->hash];
+
+        if (first == entry)
+        {
+            if (entry->sameHash != nullptr)
+                entries.set ((uint32) entry->hash, entry->sameHash);
+            else
+                entries.remove ((uint32) entry->hash);
+        }
+        else
+        {
+            Entry* previous = first;
+
+            while (previous->sameHash != entry)
+                previous = previous->sameHash;
+
+            previous->sameHash = entry->sameHash;
+        }
+
+        entry->unlink();
+        bytes -= entry->bytes;
+        --numEntries;
+        dead.add (entry);
+    }
+
+    // Makes room for a new entry, the victims at the back of the list go if
+    // they've expired or are used less often than the newcomer
+    bool makeRoom (int64 needed, int hash, uint32 now, Graveyard& dead)
+    {
+        while (bytes + needed > maxBytes)
+        {
+            Entry* const victim = lru.previous;
+
+            if (victim == &lru)
+                return false;
+
+            if ((int32) (victim->expires - now) > 0
+                 && sketch.getFrequency (hash) <= sketch.getFrequency (victim->hash))
+                return false;
+
+            remove (victim, dead);
+        }
+
+        return true;
+    }
+
+    void clear (Graveyard& dead)
+    {
+        while (lru.next != &lru)
+            remove (lru.next, dead);
+    }
+
+    int size() const    { return numEntries; }
+
+    SpinLock lock;
+    FrequencySketch sketch;
+    int64 bytes;
+
+private:
+    // Hashes can be negative, and std::abs() of the most negative int
+    // is still negative, so the table works on them unsigned
+    struct EntryHash
+    {
+        static int generateHash (const uint32 key, const int upperLimit) noexcept   { return (int) (key % (uint32) upperLimit); }
+    };
+
+    const int64 maxBytes;
+    HashMap<uint32, Entry*, EntryHash> entries;
+    int numEntries;
+    Entry lru;
+
+    JUCE_DECLARE_NON_COPYABLE (Shard);
+};
+
+
+//==============================================================================
+//==============================================================================
+HotObjectCache::HotObjectCache (int64 maxBytes, const RelativeTime& timeToLive_,
+                                int64 maxObjectSize_, int numShards)
+    : timeToLive ((uint32) jmax ((int64) 1, timeToLive_.inMilliseconds())),
+      maxObjectSize (maxObjectSize_)
+{
+    numShards = jmax (1, numShards);
+
+    for (int i = 0; i < numShards; ++i)
+        shards.add (new Shard (jmax ((int64) 1, maxBytes / numShards)));
+}
+
+HotObjectCache::~HotObjectCache()
+{
+}
+
+//==============================================================================
+HotObjectCache::Buffer::Ptr HotObjectCache::lookup (const String& bucket, const String& key)
+{
+    const int hash = getHash (bucket, key);
+    Shard& shard = getShard (hash);
+    Graveyard dead;
+
+    {
+        const SpinLock::ScopedLockType sl (shard.lock);
+
+        shard.sketch.increment (hash);
+
+        Entry* const entry = shard.find (hash, bucket, key);
+
+        if (entry != nullptr)
+        {
+            if ((int32) (entry->expires - Time::getMillisecondCounter()) > 0)
+            {
+                shard.moveToFront (entry);
+                ++hits;
+                return entry->buffer;
+            }
+
+            shard.remove (entry, dead);
+        }
+    }
+
+    ++misses;
+    return nullptr;
+}
+
+bool HotObjectCache::store (const String& bucket, const String& key, Buffer* buffer)
+{
+    if (buffer == nullptr || (int64) buffer->getSize() > maxObjectSize)
+        return false;
+
+    const int hash = getHash (bucket, key);
+    const int64 bytes = (int64) (sizeof (Entry) + buffer->getSize())
+                          + bucket.getNumBytesAsUTF8() + key.getNumBytesAsUTF8();
+    const uint32 now = Time::getMillisecondCounter();
+    Shard& shard = getShard (hash);
+    Graveyard dead;
+
+    const SpinLock::ScopedLockType sl (shard.lock);
+
+    Entry* entry = shard.find (hash, bucket, key);
+
+    // A newer copy replaces the old one rather than sitting beside it
+    if (entry != nullptr)
+        shard.remove (entry, dead);
+
+    if (! shard.makeRoom (bytes, hash, now, dead))
+        return false;
+
+    entry = new Entry();
+    entry->bucket = bucket;
+    entry->key = key;
+    entry->hash = hash;
+    entry->buffer = buffer;
+    entry->expires = now + timeToLive;
+    entry->bytes = bytes;
+    shard.add (entry);
+    return true;
+}
+
+void HotObjectCache::remove (const String& bucket, const String& key)
+{
+    const int hash = getHash (bucket, key);
+    Shard& shard = getShard (hash);
+    Graveyard dead;
+
+    const SpinLock::ScopedLockType sl (shard.lock);
+
+    Entry* const entry = shard.find (hash, bucket, key);
+
+    if (entry != nullptr)
+        shard.remove (entry, dead);
+}
+
+void HotObjectCache::clear()
+{
+    for (int i = 0; i < shards.size(); ++i)
+    {
+        Shard& shard = *shards.getUnchecked (i);
+        Graveyard dead;
+        const SpinLock::ScopedLockType sl (shard.lock);
+        shard.clear (dead);
+    }
+}
+
+//==============================================================================
+int HotObjectCache::getNumEntries() const
+{
+    int total = 0;
+
+    for (int i = 0; i < shards.size(); ++i)
+    {
+        Shard& shard = *shards.getUnchecked (i);
+        const SpinLock::ScopedLockType sl (shard.lock);
+        total += shard.size();
+    }
+
+    return total;
+}
+
+int64 HotObjectCache::getMemoryUsage() const
+{
+    int64 total = 0;
+
+    for (int i = 0; i < shards.size(); ++i)
+    {
+        Shard& shard = *shards.getUnchecked (i);
+        const SpinLock::ScopedLockType sl (shard.lock);
+        total += shard.bytes;
+    }
+
+    return total;
+}
+
+//==============================================================================
+HotObjectCache::Shard& HotObjectCache::getShard (int hash) const
+{
+    return *shards.getUnchecked ((int) ((uint32) hash % (uint32) shards.size()));
+}
+
+// The same as hashing bucket + "/" + key, without building it
+int HotObjectCache::getHash (const String& bucket, const String& key) noexcept
+{
+    int hash = bucket.hashCode();
+    hash = 31 * hash + '/';
+
+    for (String::CharPointerType t (key.getCharPointer()); ! t.isEmpty();)
+        hash = 31 * hash + (int) t.getAndAdvance();
+
+    return hash;
+}
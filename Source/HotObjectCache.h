@@ -0,0 +1,102 @@
+/*
+  ==============================================================================
+
+    HotObjectCache.h
+
+  ==============================================================================
+*/
+
+#ifndef __HOTOBJECTCACHE_H_6E03B9A4__
+#define __HOTOBJECTCACHE_H_6E03B9A4__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+
+//==============================================================================
+//==============================================================================
+/** Small, frequently read objects kept in memory.
+
+    Contents are handed out as shared read-only buffers, so a hit is a
+    reference count bump with no copy.  Each shard holds its spin lock only
+    for the table lookup.
+
+    Admission follows TinyLFU: every lookup is counted in a small
+    count-min sketch, and when the cache is full a new object only gets in
+    if it's been asked for more often than the entry it would push out.  A
+    one-off scan over lots of objects therefore can't flush the ones that
+    are read all the time.
+*/
+class HotObjectCache
+{
+public:
+    //==============================================================================
+    class Buffer  : public ReferenceCountedObject
+    {
+    public:
+        // Takes the data, leaving the block empty
+        Buffer (MemoryBlock& dataToTake, const String& etag_)
+            : etag (etag_)
+        {
+            data.swapWith (dataToTake);
+        }
+
+        const void* getData() const     { return data.getData(); }
+        size_t getSize() const          { return data.getSize(); }
+        const String& getETag() const   { return etag; }
+
+        typedef ReferenceCountedObjectPtr<Buffer> Ptr;
+
+    private:
+        MemoryBlock data;
+        const String etag;
+
+        JUCE_DECLARE_NON_COPYABLE (Buffer);
+    };
+
+    //==============================================================================
+    HotObjectCache (int64 maxBytes = 64 * 1024 * 1024,
+                    const RelativeTime& timeToLive = RelativeTime (10.0),
+                    int64 maxObjectSize = 1024 * 1024,
+                    int numShards = 16);
+
+    ~HotObjectCache();
+
+    //==============================================================================
+    // Null if it's not here or has expired
+    Buffer::Ptr lookup (const String& bucket, const String& key);
+
+    // False if it's too big or wasn't admitted
+    bool store (const String& bucket, const String& key, Buffer* buffer);
+
+    void remove (const String& bucket, const String& key);
+    void clear();
+
+    //==============================================================================
+    int getNumEntries() const;
+    int64 getMemoryUsage() const;
+
+    int64 getNumHits() const        { return hits.get(); }
+    int64 getNumMisses() const      { return misses.get(); }
+
+private:
+    //==============================================================================
+    struct Entry;
+    class FrequencySketch;
+    class Shard;
+    class Graveyard;
+
+    OwnedArray<Shard> shards;
+    const uint32 timeToLive;
+    const int64 maxObjectSize;
+    Atomic<int64> hits, misses;
+
+    //==============================================================================
+    Shard& getShard (int hash) const;
+    static int getHash (const String& bucket, const String& key) noexcept;
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HotObjectCache)
+};
+
+
+#endif  // __HOTOBJECTCACHE_H_6E03B9A4__
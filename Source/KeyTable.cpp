@@ -0,0 +1,335 @@
+/*
+  ==============================================================================
+
+    KeyTable.cpp
+
+  ==============================================================================
+*/
+
+#include "KeyTable.h"
+
+
+//==============================================================================
+//==============================================================================
+KeyTable::KeyTable()
+    : lastKeyLength (0),
+      numKeys (0),
+      keysInBlock (0)
+{
+}
+
+KeyTable::~KeyTable()
+{
+}
+
+//==============================================================================
+bool KeyTable::add (const char* utf8, size_t numBytes)
+{
+    if (numKeys > 0 && compare (utf8, numBytes, static_cast <const char*> (lastKey.getData()), lastKeyLength) <= 0)
+    {
+        jassertfalse;   // keys have to arrive sorted, and only once
+        return false;
+    }
+
+    bool restart = numKeys == 0 || keysInBlock >= restartInterval;
+    size_t shared = 0;
+
+    if (! restart)
+    {
+        const char* const last = static_cast <const char*> (lastKey.getData());
+        const size_t limit = jmin (numBytes, lastKeyLength);
+
+        while (shared < limit && utf8[shared] == last[shared])
+            ++shared;
+    }
+
+    // Blocks never straddle chunks, so a full chunk starts a new block
+    const size_t worstCase = numBytes + 20;
+    Chunk* chunk = chunks.getLast();
+
+    if (chunk == nullptr || chunk->size - chunk->used < worstCase)
+    {
+        chunk = new Chunk();
+        chunk->size = jmax ((size_t) chunkSize, worstCase);
+        chunk->data.malloc (chunk->size);
+        chunk->used = 0;
+        chunks.add (chunk);
+
+        restart = true;
+    }
+
+    if (restart)
+    {
+        const Block block = { chunk->data + chunk->used, numKeys };
+        blocks.add (block);
+
+        shared = 0;
+        keysInBlock = 0;
+    }
+
+    uint8* dest = chunk->data + chunk->used;
+    dest = writeNumber (dest, shared);
+    dest = writeNumber (dest, numBytes - shared);
+    memcpy (dest, utf8 + shared, numBytes - shared);
+    dest += numBytes - shared;
+
+    chunk->used = (size_t) (dest - chunk->data);
+
+    lastKey.ensureSize (numBytes);
+    memcpy (lastKey.getData(), utf8, numBytes);
+    lastKeyLength = numBytes;
+
+    ++numKeys;
+    ++keysInBlock;
+    return true;
+}
+
+bool KeyTable::add (const String& key)
+{
+    const CharPointer_UTF8 utf8 (key.toUTF8());
+    return add (utf8.getAddress(), utf8.sizeInBytes() - 1);
+}
+
+void KeyTable::clear()
+{
+    chunks.clear();
+    blocks.clear();
+    lastKey.setSize (0);
+    lastKeyLength = 0;
+    numKeys = 0;
+    keysInBlock = 0;
+}
+
+int64 KeyTable::getMemoryUsage() const
+{
+    int64 total = (int64) lastKey.getSize() + (int64) blocks.size() * (int64) sizeof (Block);
+
+    for (int i = 0; i < chunks.size(); ++i)
+        total += (int64) chunks.getUnchecked (i)->size;
+
+    return total;
+}
+
+//==============================================================================
+String KeyTable::operator[] (int index) const
+{
+    if (! isPositiveAndBelow (index, numKeys))
+        return String::empty;
+
+    Iterator i (*this, index);
+    i.next();
+    return i.getKey();
+}
+
+int KeyTable::indexOf (const String& key) const
+{
+    const CharPointer_UTF8 utf8 (key.toUTF8());
+    const size_t numBytes = utf8.sizeInBytes() - 1;
+
+    const int index = lowerBound (utf8.getAddress(), numBytes);
+
+    if (index >= numKeys)
+        return -1;
+
+    Iterator i (*this, index);
+    i.next();
+
+    return compare (i.getKeyData(), i.getKeyLength(), utf8.getAddress(), numBytes) == 0 ? index : -1;
+}
+
+int KeyTable::lowerBound (const char* utf8, size_t numBytes) const
+{
+    const int blockIndex = findBlock (utf8, numBytes);
+
+    if (blockIndex < 0)
+        return 0;
+
+    // The block's first key is <= the one we want and the next block's is
+    // greater, so the answer is in this block or is the next block's start
+    const int end = getBlockEnd (blockIndex);
+    Iterator i (*this, blocks.getReference (blockIndex).firstIndex);
+
+    while (i.next() && i.getIndex() < end)
+        if (compare (i.getKeyData(), i.getKeyLength(), utf8, numBytes) >= 0)
+            return i.getIndex();
+
+    return end;
+}
+
+int KeyTable::lowerBound (const String& key) const
+{
+    const CharPointer_UTF8 utf8 (key.toUTF8());
+    return lowerBound (utf8.getAddress(), utf8.sizeInBytes() - 1);
+}
+
+void KeyTable::getPrefixRange (const String& prefix, int& start, int& end) const
+{
+    const CharPointer_UTF8 utf8 (prefix.toUTF8());
+    size_t numBytes = utf8.sizeInBytes() - 1;
+
+    start = lowerBound (utf8.getAddress(), numBytes);
+
+    // Everything with the prefix sorts before the prefix with its last byte
+    // bumped up (trailing 0xff bytes can't be bumped, so they're dropped)
+    HeapBlock<char> successor (numBytes + 1);
+    memcpy (successor, utf8.getAddress(), numBytes);
+
+    while (numBytes > 0 && (uint8) successor[numBytes - 1] == 0xff)
+        --numBytes;
+
+    if (numBytes == 0)
+    {
+        end = numKeys;
+        return;
+    }
+
+    successor[numBytes - 1] = (char) ((uint8) successor[numBytes - 1] + 1);
+    end = lowerBound (successor, numBytes);
+}
+
+//==============================================================================
+int KeyTable::findBlock (int index) const
+{
+    int start = 0, end = blocks.size();
+
+    // Last block whose first index is <= index
+    while (end - start > 1)
+    {
+        const int mid = (start + end) / 2;
+
+        if (blocks.getReference (mid).firstIndex <= index)
+            start = mid;
+        else
+            end = mid;
+    }
+
+    return start;
+}
+
+int KeyTable::findBlock (const char* utf8, size_t numBytes) const
+{
+    int start = 0, end = blocks.size();
+
+    // Last block whose first key is <= the key, -1 if they're all greater
+    while (start < end)
+    {
+        const int mid = (start + end) / 2;
+
+        size_t shared, length;
+        const uint8* data = readNumber (blocks.getReference (mid).data, shared);
+        data = readNumber (data, length);
+
+        if (compare (reinterpret_cast <const char*> (data), length, utf8, numBytes) <= 0)
+            start = mid + 1;
+        else
+            end = mid;
+    }
+
+    return start - 1;
+}
+
+int KeyTable::getBlockEnd (int blockIndex) const
+{
+    return blockIndex + 1 < blocks.size() ? blocks.getReference (blockIndex + 1).firstIndex
+                                          : numKeys;
+}
+
+int KeyTable::compare (const char* a, size_t aLength, const char* b, size_t bLength) noexcept
+{
+    const int diff = memcmp (a, b, jmin (aLength, bLength));
+
+    if (diff != 0)
+        return diff;
+
+    return aLength < bLength ? -1 : (aLength > bLength ? 1 : 0);
+}
+
+uint8* KeyTable::writeNumber (uint8* dest, size_t value) noexcept
+{
+    while (value >= 0x80)
+    {
+        *dest++ = (uint8) (value | 0x80);
+        value >>= 7;
+    }
+
+    *dest++ = (uint8) value;
+    return dest;
+}
+
+const uint8* KeyTable::readNumber (const uint8* src, size_t& value) noexcept
+{
+    value = 0;
+
+    for (int shift = 0;; shift += 7)
+    {
+        const uint8 byte = *src++;
+        value |= ((size_t) (byte & 0x7f)) << shift;
+
+        if ((byte & 0x80) == 0)
+            return src;
+    }
+}
+
+
+//==============================================================================
+//==============================================================================
+KeyTable::Iterator::Iterator (const KeyTable& table_, int startIndex)
+    : table (table_),
+      index (-1),
+      blockIndex (-1),
+      blockEnd (0),
+      position (nullptr),
+      keyLength (0)
+{
+    if (startIndex > 0 && startIndex < table.numKeys)
+    {
+        // Start at the block holding the key and decode up to just before it
+        blockIndex = table.findBlock (startIndex);
+        blockEnd = table.getBlockEnd (blockIndex);
+        position = table.blocks.getReference (blockIndex).data;
+        index = table.blocks.getReference (blockIndex).firstIndex - 1;
+
+        while (index < startIndex - 1)
+            next();
+    }
+    else if (startIndex > 0)
+    {
+        index = table.numKeys;
+    }
+}
+
+bool KeyTable::Iterator::next()
+{
+    if (index + 1 >= table.numKeys)
+    {
+        index = table.numKeys;
+        return false;
+    }
+
+    if (index + 1 >= blockEnd)
+    {
+        ++blockIndex;
+        blockEnd = table.getBlockEnd (blockIndex);
+        position = table.blocks.getReference (blockIndex).data;
+    }
+
+    size_t shared, suffix;
+    position = readNumber (position, shared);
+    position = readNumber (position, suffix);
+
+    keyLength = shared + suffix;
+    key.ensureSize (keyLength + 1);
+
+    char* const data = static_cast <char*> (key.getData());
+    memcpy (data + shared, position, suffix);
+    data[keyLength] = 0;
+
+    position += suffix;
+    ++index;
+    return true;
+}
+
+String KeyTable::Iterator::getKey() const
+{
+    return String::fromUTF8 (getKeyData(), (int) keyLength);
+}
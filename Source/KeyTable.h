@@ -0,0 +1,135 @@
+/*
+  ==============================================================================
+
+    KeyTable.h
+
+  ==============================================================================
+*/
+
+#ifndef __KEYTABLE_H_E41A7C30__
+#define __KEYTABLE_H_E41A7C30__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+
+//==============================================================================
+//==============================================================================
+/** A sorted, read-mostly set of object keys packed into a few big arena chunks.
+
+    Keys must be added in ascending byte order, which is the order S3 lists
+    them in.  Each key is stored as the length it shares with the key before
+    it plus the rest of its bytes, with a full key every restartInterval keys
+    so lookups can binary search on those and decode at most one block.
+
+    Keys are UTF-8 and compared byte by byte, the same way S3 sorts them.
+*/
+class KeyTable
+{
+public:
+    //==============================================================================
+    KeyTable();
+    ~KeyTable();
+
+    //==============================================================================
+    // False (and the key isn't added) if it doesn't sort after the last one
+    bool add (const char* utf8, size_t numBytes);
+    bool add (const String& key);
+
+    void clear();
+
+    int size() const                    { return numKeys; }
+    bool isEmpty() const                { return numKeys == 0; }
+
+    // Bytes held by the arena and the block index
+    int64 getMemoryUsage() const;
+
+    //==============================================================================
+    String operator[] (int index) const;
+
+    int indexOf (const String& key) const;
+    bool contains (const String& key) const     { return indexOf (key) >= 0; }
+
+    // Index of the first key not less than the one given, size() if none
+    int lowerBound (const char* utf8, size_t numBytes) const;
+    int lowerBound (const String& key) const;
+
+    // The keys starting with the prefix are [start, end)
+    void getPrefixRange (const String& prefix, int& start, int& end) const;
+
+    //==============================================================================
+    /** Walks the keys in order, decoding each one into its own buffer.
+
+        The data returned by getKeyData() stays valid until the next call to
+        next(), no String is made unless getKey() is called.
+
+        @code
+        KeyTable::Iterator i (table, start);
+
+        while (i.next() && i.getIndex() < end)
+            fwrite (i.getKeyData(), 1, i.getKeyLength(), f);
+        @endcode
+    */
+    class Iterator
+    {
+    public:
+        Iterator (const KeyTable& table, int startIndex = 0);
+
+        bool next();
+
+        int getIndex() const                { return index; }
+        const char* getKeyData() const      { return static_cast <const char*> (key.getData()); }
+        size_t getKeyLength() const         { return keyLength; }
+        String getKey() const;
+
+    private:
+        const KeyTable& table;
+        int index;
+        int blockIndex, blockEnd;
+        const uint8* position;
+        MemoryBlock key;
+        size_t keyLength;
+
+        JUCE_DECLARE_NON_COPYABLE (Iterator);
+    };
+
+private:
+    //==============================================================================
+    struct Chunk
+    {
+        HeapBlock<uint8> data;
+        size_t size, used;
+    };
+
+    struct Block
+    {
+        const uint8* data;
+        int firstIndex;
+    };
+
+    enum
+    {
+        restartInterval = 16,
+        chunkSize = 1024 * 1024
+    };
+
+    OwnedArray<Chunk> chunks;
+    Array<Block> blocks;
+    MemoryBlock lastKey;
+    size_t lastKeyLength;
+    int numKeys, keysInBlock;
+
+    //==============================================================================
+    int findBlock (int index) const;
+    int findBlock (const char* utf8, size_t numBytes) const;
+    int getBlockEnd (int blockIndex) const;
+
+    static int compare (const char* a, size_t aLength, const char* b, size_t bLength) noexcept;
+    static uint8* writeNumber (uint8* dest, size_t value) noexcept;
+    static const uint8* readNumber (const uint8* src, size_t& value) noexcept;
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (KeyTable)
+};
+
+
+#endif  // __KEYTABLE_H_E41A7C30__
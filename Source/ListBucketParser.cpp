@@ -0,0 +1,291 @@
+/*
+  ==============================================================================
+
+    ListBucketParser.cpp
+
+  ==============================================================================
+*/
+
+#include "ListBucketParser.h"
+#include "AmazonS3.h"
+
+
+//==============================================================================
+//==============================================================================
+namespace
+{
+    bool isTag (const char* name, size_t nameLength, const char* tag)
+    {
+        return strlen (tag) == nameLength && memcmp (name, tag, nameLength) == 0;
+    }
+
+    void resetEntry (ListBucketParser::Entry& entry)
+    {
+        entry.key = String::empty;
+        entry.size = 0;
+        entry.lastModified = 0;
+        entry.etagParts = 0;
+        entry.hasETag = false;
+        zerostruct (entry.etag);
+    }
+}
+
+
+//==============================================================================
+//==============================================================================
+ListBucketParser::ListBucketParser (Listener& listener_)
+    : listener (listener_),
+      carrySize (0),
+      position (0),
+      inContents (false),
+      inCommonPrefixes (false),
+      inError (false),
+      complete (false),
+      truncated (false),
+      numEntries (0)
+{
+    resetEntry (current);
+}
+
+ListBucketParser::~ListBucketParser()
+{
+}
+
+//==============================================================================
+String ListBucketParser::getNextMarker() const
+{
+    return nextMarker.isNotEmpty() ? nextMarker : lastKey;
+}
+
+//==============================================================================
+bool ListBucketParser::write (const void* data, int numBytes)
+{
+    if (numBytes <= 0)
+        return true;
+
+    position += numBytes;
+
+    // Parse straight out of the caller's buffer when nothing is left over
+    // from last time, only the incomplete tail gets copied
+    if (carrySize == 0)
+    {
+        const size_t used = parse (static_cast <const char*> (data), (size_t) numBytes);
+
+        carrySize = (size_t) numBytes - used;
+
+        if (carry.getSize() < carrySize)
+            carry.setSize (carrySize);
+
+        memcpy (carry.getData(), static_cast <const char*> (data) + used, carrySize);
+        return true;
+    }
+
+    if (carry.getSize() < carrySize + (size_t) numBytes)
+        carry.setSize (carrySize + (size_t) numBytes);
+
+    memcpy (static_cast <char*> (carry.getData()) + carrySize, data, (size_t) numBytes);
+    carrySize += (size_t) numBytes;
+
+    const size_t used = parse (static_cast <const char*> (carry.getData()), carrySize);
+
+    carrySize -= used;
+    memmove (carry.getData(), static_cast <const char*> (carry.getData()) + used, carrySize);
+    return true;
+}
+
+//==============================================================================
+size_t ListBucketParser::parse (const char* data, size_t size)
+{
+    const char* p = data;
+    const char* const end = data + size;
+
+    for (;;)
+    {
+        const char* open = static_cast <const char*> (memchr (p, '<', (size_t) (end - p)));
+
+        if (open == nullptr)
+            return size;
+
+        const char* close = static_cast <const char*> (memchr (open, '>', (size_t) (end - open)));
+
+        // Incomplete tag, wait for more
+        if (close == nullptr)
+            return (size_t) (open - data);
+
+        // <?xml ...?>, comments etc
+        if (open[1] == '?' || open[1] == '!')
+        {
+            p = close + 1;
+            continue;
+        }
+
+        const bool closing = open[1] == '/';
+        const bool selfClosing = close[-1] == '/';
+
+        const char* name = open + (closing ? 2 : 1);
+        const char* nameEnd = name;
+
+        while (nameEnd < close && *nameEnd != ' ' && *nameEnd != '/' && *nameEnd != '\t'
+                && *nameEnd != '\r' && *nameEnd != '\n')
+            ++nameEnd;
+
+        if (closing || selfClosing)
+        {
+            handleTag (name, (size_t) (nameEnd - name), true);
+            p = close + 1;
+            continue;
+        }
+
+        handleTag (name, (size_t) (nameEnd - name), false);
+
+        // Leaf text runs up to the next '<', which must have arrived before
+        // we can use it
+        const char* textEnd = static_cast <const char*> (memchr (close + 1, '<', (size_t) (end - (close + 1))));
+
+        // (opening tags are safe to see twice)
+        if (textEnd == nullptr)
+            return (size_t) (open - data);
+
+        if (textEnd > close + 1)
+            handleText (name, (size_t) (nameEnd - name), close + 1, textEnd);
+
+        p = textEnd;
+    }
+}
+
+//==============================================================================
+void ListBucketParser::handleTag (const char* name, size_t nameLength, bool closing)
+{
+    if (isTag (name, nameLength, "Contents"))
+    {
+        if (! closing)
+        {
+            resetEntry (current);
+            inContents = true;
+        }
+        else if (inContents)
+        {
+            inContents = false;
+            lastKey = current.key;
+            ++numEntries;
+            listener.listEntry (current);
+        }
+    }
+    else if (isTag (name, nameLength, "CommonPrefixes"))
+    {
+        inCommonPrefixes = ! closing;
+    }
+    else if (isTag (name, nameLength, "ListBucketResult"))
+    {
+        complete = closing;
+    }
+    else if (isTag (name, nameLength, "Error"))
+    {
+        inError = ! closing;
+    }
+}
+
+void ListBucketParser::handleText (const char* name, size_t nameLength, const char* text, const char* textEnd)
+{
+    if (inContents)
+    {
+        if (isTag (name, nameLength, "Key"))
+        {
+            current.key = decodeText (text, textEnd);
+        }
+        else if (isTag (name, nameLength, "Size"))
+        {
+            int64 size = 0;
+
+            for (const char* t = text; t < textEnd && *t >= '0' && *t <= '9'; ++t)
+                size = size * 10 + (*t - '0');
+
+            current.size = size;
+        }
+        else if (isTag (name, nameLength, "ETag"))
+        {
+            current.hasETag = S3ObjectInfo::parseETag (decodeText (text, textEnd), current.etag, current.etagParts);
+        }
+        else if (isTag (name, nameLength, "LastModified"))
+        {
+            current.lastModified = S3ObjectInfo::parseISO8601 (decodeText (text, textEnd));
+        }
+    }
+    else if (inCommonPrefixes)
+    {
+        if (isTag (name, nameLength, "Prefix"))
+            listener.listCommonPrefix (decodeText (text, textEnd));
+    }
+    else if (inError)
+    {
+        if (isTag (name, nameLength, "Code"))
+            errorCode = decodeText (text, textEnd);
+        else if (isTag (name, nameLength, "Message"))
+            errorMessage = decodeText (text, textEnd);
+    }
+    else if (isTag (name, nameLength, "IsTruncated"))
+    {
+        truncated = (textEnd - text) == 4 && memcmp (text, "true", 4) == 0;
+    }
+    else if (isTag (name, nameLength, "NextMarker"))
+    {
+        nextMarker = decodeText (text, textEnd);
+    }
+    else if (isTag (name, nameLength, "NextContinuationToken"))
+    {
+        nextContinuationToken = decodeText (text, textEnd);
+    }
+}
+
+//==============================================================================
+String ListBucketParser::decodeText (const char* text, const char* textEnd)
+{
+    if (memchr (text, '&', (size_t) (textEnd - text)) == nullptr)
+        return String (CharPointer_UTF8 (text), CharPointer_UTF8 (textEnd));
+
+    MemoryOutputStream out ((size_t) (textEnd - text));
+
+    while (text < textEnd)
+    {
+        if (*text != '&')
+        {
+            out.writeByte (*text++);
+            continue;
+        }
+
+        const char* semi = static_cast <const char*> (memchr (text, ';', (size_t) (textEnd - text)));
+
+        if (semi == nullptr)
+        {
+            out.writeByte (*text++);
+            continue;
+        }
+
+        const String entity (CharPointer_UTF8 (text + 1), CharPointer_UTF8 (semi));
+
+        if (entity == "amp")          out.writeByte ('&');
+        else if (entity == "lt")      out.writeByte ('<');
+        else if (entity == "gt")      out.writeByte ('>');
+        else if (entity == "quot")    out.writeByte ('"');
+        else if (entity == "apos")    out.writeByte ('\'');
+        else if (entity.startsWithChar ('#'))
+        {
+            const int c = entity[1] == 'x' ? entity.substring (2).getHexValue32()
+                                           : entity.substring (1).getIntValue();
+
+            char utf8[8] = { 0 };
+            CharPointer_UTF8 dest (utf8);
+            dest.write ((juce_wchar) c);
+            out.write (utf8, (int) CharPointer_UTF8::getBytesRequiredFor ((juce_wchar) c));
+        }
+        else
+        {
+            out.write (text, (int) (semi + 1 - text));
+        }
+
+        text = semi + 1;
+    }
+
+    return String (CharPointer_UTF8 (static_cast <const char*> (out.getData())),
+                   CharPointer_UTF8 (static_cast <const char*> (out.getData()) + out.getDataSize()));
+}
@@ -0,0 +1,103 @@
+/*
+  ==============================================================================
+
+    ListBucketParser.h
+
+  ==============================================================================
+*/
+
+#ifndef __LISTBUCKETPARSER_H_6D2F0B1E__
+#define __LISTBUCKETPARSER_H_6D2F0B1E__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+
+//==============================================================================
+//==============================================================================
+/** Streaming parser for ListBucketResult responses.
+
+    Write the response bytes to it as they come off the wire, in chunks of
+    any size, and each <Contents> entry is handed to the listener as soon as
+    its closing tag arrives.  No DOM is built; only the tags we care about are
+    looked at and the rest of the text is skipped with memchr.
+*/
+class ListBucketParser  : public OutputStream
+{
+public:
+    //==============================================================================
+    struct Entry
+    {
+        String key;
+        int64 size;
+        int64 lastModified;     // milliseconds since 1970
+        uint8 etag[16];
+        int etagParts;          // non-zero for multipart ETags
+        bool hasETag;
+    };
+
+    //==============================================================================
+    class Listener
+    {
+    public:
+        virtual ~Listener() {}
+
+        virtual void listEntry (const Entry& entry) = 0;
+        virtual void listCommonPrefix (const String& /*prefix*/) {}
+    };
+
+    //==============================================================================
+    explicit ListBucketParser (Listener& listener);
+    ~ListBucketParser();
+
+    //==============================================================================
+    // True once the closing </ListBucketResult> has been seen
+    bool isComplete() const             { return complete; }
+    bool isTruncated() const            { return truncated; }
+
+    // Where the next page starts, NextMarker if the server sent one, otherwise
+    // the last key (V1 listings only send NextMarker with a delimiter)
+    String getNextMarker() const;
+    String getNextContinuationToken() const     { return nextContinuationToken; }
+    String getLastKey() const                   { return lastKey; }
+
+    int getNumEntries() const           { return numEntries; }
+
+    // Set if S3 sent an <Error> document instead
+    String getErrorCode() const         { return errorCode; }
+    String getErrorMessage() const      { return errorMessage; }
+
+    //==============================================================================
+    bool write (const void* data, int numBytes);
+    void flush() {}
+    bool setPosition (int64) { return false; }
+    int64 getPosition()      { return position; }
+
+private:
+    //==============================================================================
+    Listener& listener;
+
+    MemoryBlock carry;
+    size_t carrySize;
+    int64 position;
+
+    Entry current;
+    bool inContents, inCommonPrefixes, inError;
+    bool complete, truncated;
+    int numEntries;
+
+    String lastKey, nextMarker, nextContinuationToken;
+    String errorCode, errorMessage;
+
+    //==============================================================================
+    size_t parse (const char* data, size_t size);
+    void handleTag (const char* name, size_t nameLength, bool closing);
+    void handleText (const char* name, size_t nameLength, const char* text, const char* textEnd);
+
+    static String decodeText (const char* text, const char* textEnd);
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ListBucketParser)
+};
+
+
+#endif  // __LISTBUCKETPARSER_H_6D2F0B1E__
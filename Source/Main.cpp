@@ -10,6 +10,7 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "MainWindow.h"
+#include "TransferBufferPool.h"
 
 
 //==============================================================================
@@ -36,6 +37,9 @@ public:
     {
         // Do your application's shutdown code here..
         mainWindow = 0;
+
+        // Last, once nothing can be holding a buffer
+        TransferBufferPool::deleteInstance();
     }
 
     //==============================================================================
@@ -76,7 +76,7 @@ MainAppWindow::MainAppWindow()
             Logger::outputDebugString ("Get OK");
     }
     Logger::outputDebugString (obj.getResult());
-    Logger::outputDebugString (obj.getInfo().getRawHeader());
+    Logger::outputDebugString (obj.getInfo().toString());
 
     if (s3.putObject (obj, File (CharPointer_UTF8 ("~/Src/aws/test"))))
     {
@@ -84,7 +84,7 @@ MainAppWindow::MainAppWindow()
             Logger::outputDebugString ("Put OK");
     }
     Logger::outputDebugString (obj.getResult());
-    Logger::outputDebugString (obj.getInfo().getRawHeader());
+    Logger::outputDebugString (obj.getInfo().toString());
 
     obj.setId ("testObj666");
     if (s3.putObject (obj, File (CharPointer_UTF8 ("~/Src/aws/test2")), true))
@@ -93,19 +93,19 @@ MainAppWindow::MainAppWindow()
             Logger::outputDebugString ("Put 666 OK");
     }
     Logger::outputDebugString (obj.getResult());
-    Logger::outputDebugString (obj.getInfo().getRawHeader());
+    Logger::outputDebugString (obj.getInfo().toString());
     
     obj.setId ("testObj666?acl");
     if (s3.getObject (obj, File (CharPointer_UTF8 ("~/Src/aws/test-acl"))))
         if (obj.isSuccess())
             Logger::outputDebugString ("Get ACL OK");
-    Logger::outputDebugString (obj.getInfo().getRawHeader());
+    Logger::outputDebugString (obj.getInfo().toString());
     
     obj.setId ("");
     if (s3.getObject (obj, File (CharPointer_UTF8 ("~/Src/aws/test-ls"))))
         if (obj.isSuccess())
             Logger::outputDebugString ("Get LS OK");
-    Logger::outputDebugString (obj.getInfo().getRawHeader());
+    Logger::outputDebugString (obj.getInfo().toString());
     
     StringArray list;
     if (s3.getDirectory ("com.pearsports.mobiledata", list))
@@ -0,0 +1,238 @@
+/*
+  ==============================================================================
+
+    MetadataCache.cpp
+
+  ==============================================================================
+*/
+
+#include "MetadataCache.h"
+#include "AmazonS3.h"
+
+
+//==============================================================================
+//==============================================================================
+struct MetadataCache::Entry
+{
+    Entry() : expires (0), bytes (0), previous (this), next (this) {}
+
+    String name;
+    S3ObjectInfo info;
+    uint32 expires;
+    int64 bytes;
+    Entry* previous;
+    Entry* next;
+};
+
+//==============================================================================
+// One lock, one map and one LRU list, most recently used at the front
+class MetadataCache::Shard
+{
+public:
+    Shard (int64 maxBytes_) : bytes (0), maxBytes (maxBytes_) {}
+    ~Shard()    { clear(); }
+
+    Entry* find (const String& name) const      { return entries [name]; }
+
+    void moveToFront (Entry* entry)
+    {
+        unlink (entry);
+        entry->previous = &lru;
+        entry->next = lru.next;
+        lru.next->previous = entry;
+        lru.next = entry;
+    }
+
+    void add (Entry* entry)
+    {
+        entries.set (entry->name, entry);
+        bytes += entry->bytes;
+        moveToFront (entry);
+    }
+
+    void remove (Entry* entry)
+    {
+        unlink (entry);
+        entries.remove (entry->name);
+        bytes -= entry->bytes;
+        delete entry;
+    }
+
+    // Drops entries from the back until we're under the limit, never the
+    // one just stored
+    void trim (Entry* keep)
+    {
+        while (bytes > maxBytes && lru.previous != &lru && lru.previous != keep)
+            remove (lru.previous);
+    }
+
+    void clear()
+    {
+        while (lru.next != &lru)
+            remove (lru.next);
+    }
+
+    int size() const    { return entries.size(); }
+
+    CriticalSection lock;
+    int64 bytes;
+
+private:
+    const int64 maxBytes;
+    HashMap<String, Entry*> entries;
+    Entry lru;
+
+    static void unlink (Entry* entry)
+    {
+        entry->previous->next = entry->next;
+        entry->next->previous = entry->previous;
+        entry->previous = entry->next = entry;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (Shard);
+};
+
+
+//==============================================================================
+//==============================================================================
+MetadataCache::MetadataCache (int64 maxBytes, const RelativeTime& timeToLive_, int numShards,
+                              const RelativeTime& notFoundTimeToLive_)
+    : timeToLive ((uint32) jmax ((int64) 1, timeToLive_.inMilliseconds())),
+      notFoundTimeToLive ((uint32) jmax ((int64) 1, notFoundTimeToLive_.inMilliseconds()))
+{
+    numShards = jmax (1, numShards);
+
+    for (int i = 0; i < numShards; ++i)
+        shards.add (new Shard (jmax ((int64) 1, maxBytes / numShards)));
+}
+
+MetadataCache::~MetadataCache()
+{
+}
+
+//==============================================================================
+bool MetadataCache::lookup (const String& bucket, const String& key, S3ObjectInfo& info)
+{
+    const String name (getName (bucket, key));
+    Shard& shard = getShard (name);
+
+    {
+        const ScopedLock sl (shard.lock);
+
+        Entry* const entry = shard.find (name);
+
+        if (entry != nullptr)
+        {
+            // Signed difference so the millisecond counter can wrap
+            if ((int32) (entry->expires - Time::getMillisecondCounter()) > 0)
+            {
+                shard.moveToFront (entry);
+                info = entry->info;
+                ++hits;
+                return true;
+            }
+
+            shard.remove (entry);
+        }
+    }
+
+    ++misses;
+    return false;
+}
+
+void MetadataCache::store (const String& bucket, const String& key, const S3ObjectInfo& info)
+{
+    const bool notFound = info.getStatus() == 404;
+
+    if (! (info.isSuccess() || notFound))
+        return;
+
+    const String name (getName (bucket, key));
+    Shard& shard = getShard (name);
+
+    const ScopedLock sl (shard.lock);
+
+    Entry* entry = shard.find (name);
+
+    if (entry == nullptr)
+    {
+        // Room for the kept x-amz-* and content headers is a guess
+        entry = new Entry();
+        entry->name = name;
+        entry->bytes = (int64) sizeof (Entry) + name.getNumBytesAsUTF8() + 256;
+        shard.add (entry);
+    }
+    else
+    {
+        shard.moveToFront (entry);
+    }
+
+    entry->info = info;
+    entry->expires = Time::getMillisecondCounter() + (notFound ? notFoundTimeToLive : timeToLive);
+
+    shard.trim (entry);
+}
+
+void MetadataCache::remove (const String& bucket, const String& key)
+{
+    const String name (getName (bucket, key));
+    Shard& shard = getShard (name);
+
+    const ScopedLock sl (shard.lock);
+
+    Entry* const entry = shard.find (name);
+
+    if (entry != nullptr)
+        shard.remove (entry);
+}
+
+void MetadataCache::clear()
+{
+    for (int i = 0; i < shards.size(); ++i)
+    {
+        Shard& shard = *shards.getUnchecked (i);
+        const ScopedLock sl (shard.lock);
+        shard.clear();
+    }
+}
+
+//==============================================================================
+int MetadataCache::getNumEntries() const
+{
+    int total = 0;
+
+    for (int i = 0; i < shards.size(); ++i)
+    {
+        Shard& shard = *shards.getUnchecked (i);
+        const ScopedLock sl (shard.lock);
+        total += shard.size();
+    }
+
+    return total;
+}
+
+int64 MetadataCache::getMemoryUsage() const
+{
+    int64 total = 0;
+
+    for (int i = 0; i < shards.size(); ++i)
+    {
+        Shard& shard = *shards.getUnchecked (i);
+        const ScopedLock sl (shard.lock);
+        total += shard.bytes;
+    }
+
+    return total;
+}
+
+//==============================================================================
+MetadataCache::Shard& MetadataCache::getShard (const String& name) const
+{
+    return *shards.getUnchecked ((int) ((uint32) name.hashCode() % (uint32) shards.size()));
+}
+
+String MetadataCache::getName (const String& bucket, const String& key)
+{
+    // Bucket names can't contain a slash, so this can't be ambiguous
+    return bucket + "/" + key;
+}
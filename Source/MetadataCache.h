@@ -0,0 +1,78 @@
+/*
+  ==============================================================================
+
+    MetadataCache.h
+
+  ==============================================================================
+*/
+
+#ifndef __METADATACACHE_H_19F0B6D3__
+#define __METADATACACHE_H_19F0B6D3__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+class S3ObjectInfo;
+
+
+//==============================================================================
+//==============================================================================
+/** Remembers recent HEAD results so the same object isn't asked about twice.
+
+    Entries expire after the time to live, and the least recently used ones
+    are dropped once the cache goes over its size.  The cache is split into
+    shards by key, each with its own lock and LRU list, so threads working on
+    different objects rarely wait on each other.
+
+    Not Found results are kept too, for a shorter time, so a key that
+    doesn't exist isn't asked about over and over.
+
+    Sizes are estimates (the entry, its name and a fixed allowance for the
+    kept headers) rather than exact heap usage.
+*/
+class MetadataCache
+{
+public:
+    //==============================================================================
+    MetadataCache (int64 maxBytes = 16 * 1024 * 1024,
+                   const RelativeTime& timeToLive = RelativeTime (30.0),
+                   int numShards = 16,
+                   const RelativeTime& notFoundTimeToLive = RelativeTime (5.0));
+
+    ~MetadataCache();
+
+    //==============================================================================
+    // False if there's no live entry for the object.  A cached miss comes
+    // back as true, with a 404 in the info.
+    bool lookup (const String& bucket, const String& key, S3ObjectInfo& info);
+
+    // Successes and 404s are kept, any other result is ignored
+    void store (const String& bucket, const String& key, const S3ObjectInfo& info);
+    void remove (const String& bucket, const String& key);
+    void clear();
+
+    //==============================================================================
+    int getNumEntries() const;
+    int64 getMemoryUsage() const;
+
+    int64 getNumHits() const        { return hits.get(); }
+    int64 getNumMisses() const      { return misses.get(); }
+
+private:
+    //==============================================================================
+    struct Entry;
+    class Shard;
+
+    OwnedArray<Shard> shards;
+    const uint32 timeToLive, notFoundTimeToLive;
+    Atomic<int64> hits, misses;
+
+    //==============================================================================
+    Shard& getShard (const String& name) const;
+    static String getName (const String& bucket, const String& key);
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MetadataCache)
+};
+
+
+#endif  // __METADATACACHE_H_19F0B6D3__
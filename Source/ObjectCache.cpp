@@ -0,0 +1,360 @@
+/*
+  ==============================================================================
+
+    ObjectCache.cpp
+
+  ==============================================================================
+*/
+
+#include "ObjectCache.h"
+
+
+//==============================================================================
+//==============================================================================
+// A key's entry, on a circular LRU list with the most recently used first
+struct ObjectCache::Entry
+{
+    Entry() : size (0), previous (this), next (this) {}
+
+    void unlink()
+    {
+        previous->next = next;
+        next->previous = previous;
+        previous = next = this;
+    }
+
+    void insertAfter (Entry* other)
+    {
+        previous = other;
+        next = other->next;
+        other->next->previous = this;
+        other->next = this;
+    }
+
+    String name, etag;
+    int64 size;
+    Entry* previous;
+    Entry* next;
+};
+
+
+//==============================================================================
+//==============================================================================
+ObjectCache::ObjectCache (const File& directory_, int64 maxBytes_)
+    : directory (directory_),
+      maxBytes (maxBytes_),
+      staleWhileRevalidate (false),
+      lru (new Entry()),
+      totalBytes (0),
+      changed (false)
+{
+    directory.createDirectory();
+    load();
+}
+
+ObjectCache::~ObjectCache()
+{
+    save();
+
+    while (lru->next != lru)
+    {
+        Entry* const entry = lru->next;
+        entry->unlink();
+        delete entry;
+    }
+}
+
+//==============================================================================
+bool ObjectCache::lookup (const String& bucket, const String& key, String& etag, File& body)
+{
+    const ScopedLock sl (lock);
+
+    Entry* const entry = entries [getName (bucket, key)];
+
+    if (entry == nullptr)
+        return false;
+
+    body = getBodyFile (entry->etag);
+
+    // Someone's been tidying up the directory
+    if (! body.existsAsFile() || body.getSize() != entry->size)
+    {
+        removeEntry (entry);
+        return false;
+    }
+
+    moveToFront (entry);
+    etag = entry->etag;
+    return true;
+}
+
+bool ObjectCache::store (const String& bucket, const String& key, const String& etag, const File& downloaded)
+{
+    if (! isUsableETag (etag))
+    {
+        downloaded.deleteFile();
+        return false;
+    }
+
+    const String name (getName (bucket, key));
+    const int64 size = downloaded.getSize();
+    const File body (getBodyFile (etag));
+
+    const ScopedLock sl (lock);
+
+    // Same content under another key, we already have it
+    if (body.existsAsFile() && body.getSize() == size)
+    {
+        downloaded.deleteFile();
+    }
+    else
+    {
+        body.getParentDirectory().createDirectory();
+
+        if (! downloaded.moveFileTo (body))
+        {
+            downloaded.deleteFile();
+            return false;
+        }
+    }
+
+    Entry* const existing = entries [name];
+
+    if (existing != nullptr)
+    {
+        if (existing->etag == etag)
+        {
+            moveToFront (existing);
+            return true;
+        }
+
+        removeEntry (existing);
+    }
+
+    add (name, etag, size);
+    trim (entries [name]);
+    return true;
+}
+
+void ObjectCache::remove (const String& bucket, const String& key)
+{
+    const ScopedLock sl (lock);
+
+    Entry* const entry = entries [getName (bucket, key)];
+
+    if (entry != nullptr)
+        removeEntry (entry);
+}
+
+File ObjectCache::createTemporaryFile() const
+{
+    const File temp (directory.getChildFile ("tmp"));
+    temp.createDirectory();
+
+    // Random rather than the next free name, two downloads could be
+    // picking at once
+    return temp.getChildFile ("download-" + String::toHexString (Random::getSystemRandom().nextInt64()));
+}
+
+//==============================================================================
+int ObjectCache::getNumEntries() const
+{
+    const ScopedLock sl (lock);
+    return entries.size();
+}
+
+int64 ObjectCache::getTotalSize() const
+{
+    const ScopedLock sl (lock);
+    return totalBytes;
+}
+
+bool ObjectCache::save()
+{
+    const ScopedLock sl (lock);
+
+    if (! changed)
+        return true;
+
+    // Oldest first, so loading it back in order rebuilds the LRU list
+    String text;
+
+    for (Entry* entry = lru->previous; entry != lru; entry = entry->previous)
+    {
+        // Can't be written as a line, it just won't survive a restart
+        if (entry->name.containsAnyOf ("\r\n"))
+            continue;
+
+        text << entry->etag << '\t' << String (entry->size) << '\t' << entry->name << '\n';
+    }
+
+    // With no name, a body that's still to be deleted
+    HashMap<String, int64>::Iterator i (pendingDeletes);
+
+    while (i.next())
+        text << i.getKey() << '\t' << String (i.getValue()) << "\t\n";
+
+    TemporaryFile temp (getIndexFile());
+
+    if (! (temp.getFile().replaceWithText (text) && temp.overwriteTargetFileWithTemporary()))
+        return false;
+
+    changed = false;
+    return true;
+}
+
+//==============================================================================
+File ObjectCache::getBodyFile (const String& etag) const
+{
+    return directory.getChildFile ("objects")
+                    .getChildFile (etag.substring (0, 2))
+                    .getChildFile (etag);
+}
+
+void ObjectCache::load()
+{
+    // Anything left in tmp is from a download that never finished
+    directory.getChildFile ("tmp").deleteRecursively();
+
+    StringArray lines;
+    lines.addLines (getIndexFile().loadFileAsString());
+
+    for (int i = 0; i < lines.size(); ++i)
+    {
+        const String& line = lines[i];
+
+        const int firstTab = line.indexOfChar ('\t');
+        const int secondTab = line.indexOfChar (firstTab + 1, '\t');
+
+        if (firstTab <= 0 || secondTab <= firstTab)
+            continue;
+
+        const String etag (line.substring (0, firstTab));
+        const int64 size = line.substring (firstTab + 1, secondTab).getLargeIntValue();
+        const String name (line.substring (secondTab + 1));
+
+        if (! isUsableETag (etag))
+            continue;
+
+        if (name.isEmpty())
+        {
+            if (! bodyUsers.contains (etag) && ! pendingDeletes.contains (etag)
+                 && getBodyFile (etag).exists())
+            {
+                pendingDeletes.set (etag, size);
+                totalBytes += size;
+            }
+        }
+        else if (! entries.contains (name) && getBodyFile (etag).getSize() == size)
+        {
+            add (name, etag, size);
+        }
+    }
+
+    trim (nullptr);
+    changed = false;
+}
+
+void ObjectCache::add (const String& name, const String& etag, int64 size)
+{
+    Entry* const entry = new Entry();
+    entry->name = name;
+    entry->etag = etag;
+    entry->size = size;
+    entry->insertAfter (lru);
+
+    entries.set (name, entry);
+
+    const int users = bodyUsers [etag];
+
+    // A body that's waiting to be deleted is already counted
+    if (users == 0)
+    {
+        if (pendingDeletes.contains (etag))
+            pendingDeletes.remove (etag);
+        else
+            totalBytes += size;
+    }
+
+    bodyUsers.set (etag, users + 1);
+    changed = true;
+}
+
+void ObjectCache::removeEntry (Entry* entry)
+{
+    entry->unlink();
+    entries.remove (entry->name);
+
+    const int users = bodyUsers [entry->etag] - 1;
+
+    if (users <= 0)
+    {
+        bodyUsers.remove (entry->etag);
+
+        // Anyone with it mapped keeps their view of it, except on Windows,
+        // which won't delete it until they're done
+        if (getBodyFile (entry->etag).deleteFile())
+            totalBytes -= entry->size;
+        else
+            pendingDeletes.set (entry->etag, entry->size);
+    }
+    else
+    {
+        bodyUsers.set (entry->etag, users);
+    }
+
+    delete entry;
+    changed = true;
+}
+
+void ObjectCache::moveToFront (Entry* entry)
+{
+    if (lru->next != entry)
+    {
+        entry->unlink();
+        entry->insertAfter (lru);
+        changed = true;
+    }
+}
+
+void ObjectCache::trim (Entry* keep)
+{
+    retryDeletes();
+
+    while (totalBytes > maxBytes && lru->previous != lru && lru->previous != keep)
+        removeEntry (lru->previous);
+}
+
+void ObjectCache::retryDeletes()
+{
+    StringArray deleted;
+    HashMap<String, int64>::Iterator i (pendingDeletes);
+
+    while (i.next())
+    {
+        if (getBodyFile (i.getKey()).deleteFile())
+        {
+            totalBytes -= i.getValue();
+            deleted.add (i.getKey());
+        }
+    }
+
+    for (int n = 0; n < deleted.size(); ++n)
+        pendingDeletes.remove (deleted[n]);
+
+    if (deleted.size() > 0)
+        changed = true;
+}
+
+//==============================================================================
+String ObjectCache::getName (const String& bucket, const String& key)
+{
+    return bucket + "/" + key;
+}
+
+bool ObjectCache::isUsableETag (const String& etag)
+{
+    // Hex, with "-N" for multipart, anything else won't do as a file name
+    return etag.isNotEmpty() && etag.length() <= 64
+            && etag.containsOnly ("0123456789abcdefABCDEF-");
+}
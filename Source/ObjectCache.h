@@ -0,0 +1,98 @@
+/*
+  ==============================================================================
+
+    ObjectCache.h
+
+  ==============================================================================
+*/
+
+#ifndef __OBJECTCACHE_H_3AC85E17__
+#define __OBJECTCACHE_H_3AC85E17__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+
+//==============================================================================
+//==============================================================================
+/** Local copies of downloaded objects, kept in a directory on disk.
+
+    Bodies are stored once per ETag under objects/, so keys with the same
+    content share a file, and an index maps bucket and key to the ETag.  The
+    least recently used keys are dropped once the bodies add up to more
+    than the size limit.  The index is written back by save() and by the
+    destructor.
+
+    A body that can't be deleted yet, as on Windows while something still
+    has it mapped, is tried again on later stores and after a restart, and
+    counts towards the limit until it's gone.
+
+    AmazonS3 revalidates a copy with If-None-Match before using it, so an
+    unchanged object costs a 304 and no body.  With stale-while-revalidate
+    set the copy is used straight away and checked in the background.
+*/
+class ObjectCache
+{
+public:
+    //==============================================================================
+    ObjectCache (const File& directory, int64 maxBytes = (int64) 1024 * 1024 * 1024);
+    ~ObjectCache();
+
+    //==============================================================================
+    void setStaleWhileRevalidate (bool shouldServeStale)    { staleWhileRevalidate = shouldServeStale; }
+    bool isStaleWhileRevalidate() const                     { return staleWhileRevalidate; }
+
+    //==============================================================================
+    // The ETag and body of the cached copy, false if there isn't one
+    bool lookup (const String& bucket, const String& key, String& etag, File& body);
+
+    // Moves a downloaded body into the store, it has to be one of our
+    // temporary files so it's on the same volume
+    bool store (const String& bucket, const String& key, const String& etag, const File& downloaded);
+
+    void remove (const String& bucket, const String& key);
+
+    // Somewhere to download to before calling store()
+    File createTemporaryFile() const;
+
+    //==============================================================================
+    int getNumEntries() const;
+    int64 getTotalSize() const;
+
+    bool save();
+
+private:
+    //==============================================================================
+    struct Entry;
+
+    const File directory;
+    const int64 maxBytes;
+    bool staleWhileRevalidate;
+
+    CriticalSection lock;
+    HashMap<String, Entry*> entries;
+    HashMap<String, int> bodyUsers;
+    HashMap<String, int64> pendingDeletes;     // etag to size
+    ScopedPointer<Entry> lru;
+    int64 totalBytes;
+    bool changed;
+
+    //==============================================================================
+    File getBodyFile (const String& etag) const;
+    File getIndexFile() const           { return directory.getChildFile ("index"); }
+
+    void load();
+    void add (const String& name, const String& etag, int64 size);
+    void removeEntry (Entry* entry);
+    void moveToFront (Entry* entry);
+    void trim (Entry* keep);
+    void retryDeletes();
+
+    static String getName (const String& bucket, const String& key);
+    static bool isUsableETag (const String& etag);
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ObjectCache)
+};
+
+
+#endif  // __OBJECTCACHE_H_3AC85E17__
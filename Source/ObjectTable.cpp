@@ -0,0 +1,195 @@
+/*
+  ==============================================================================
+
+    ObjectTable.cpp
+
+  ==============================================================================
+*/
+
+#include "ObjectTable.h"
+
+
+//==============================================================================
+//==============================================================================
+// Orders row numbers by one column, ties go by key so the result is stable
+template <class ColumnType>
+class ObjectTable::ColumnComparator
+{
+public:
+    ColumnComparator (const ColumnType* values_, const int* keyIndices_, bool descending_)
+        : values (values_), keyIndices (keyIndices_), descending (descending_) {}
+
+    int compareElements (int first, int second) const
+    {
+        if (values[first] != values[second])
+            return ((values[first] < values[second]) != descending) ? -1 : 1;
+
+        return keyIndices[first] - keyIndices[second];
+    }
+
+private:
+    const ColumnType* const values;
+    const int* const keyIndices;
+    const bool descending;
+
+    JUCE_DECLARE_NON_COPYABLE (ColumnComparator);
+};
+
+
+//==============================================================================
+//==============================================================================
+ObjectTable::ObjectTable()
+{
+}
+
+ObjectTable::~ObjectTable()
+{
+}
+
+//==============================================================================
+bool ObjectTable::add (const ListBucketParser::Entry& entry)
+{
+    if (! keys.add (entry.key))
+        return false;
+
+    ETag etag;
+
+    if (entry.hasETag)
+        memcpy (etag.data, entry.etag, sizeof (etag.data));
+    else
+        zerostruct (etag.data);
+
+    keyIndices.add (keys.size() - 1);
+    sizes.add (entry.size);
+    lastModified.add (entry.lastModified);
+    etags.add (etag);
+    etagParts.add ((uint16) entry.etagParts);
+    return true;
+}
+
+void ObjectTable::clear()
+{
+    keys.clear();
+    keyIndices.clear();
+    sizes.clear();
+    lastModified.clear();
+    etags.clear();
+    etagParts.clear();
+}
+
+//==============================================================================
+int64 ObjectTable::getTotalSize() const
+{
+    return getTotalSize (0, size());
+}
+
+int64 ObjectTable::getTotalSize (int startRow, int endRow) const
+{
+    startRow = jmax (0, startRow);
+    endRow = jmin (size(), endRow);
+
+    const int64* const column = sizes.begin();
+    int64 total = 0;
+
+    for (int i = startRow; i < endRow; ++i)
+        total += column[i];
+
+    return total;
+}
+
+void ObjectTable::findModifiedSince (int64 time, Array<int>& rows) const
+{
+    const int64* const column = lastModified.begin();
+    const int numRows = size();
+
+    for (int i = 0; i < numRows; ++i)
+        if (column[i] >= time)
+            rows.add (i);
+}
+
+void ObjectTable::findLargerThan (int64 minSize, Array<int>& rows) const
+{
+    const int64* const column = sizes.begin();
+    const int numRows = size();
+
+    for (int i = 0; i < numRows; ++i)
+        if (column[i] > minSize)
+            rows.add (i);
+}
+
+//==============================================================================
+void ObjectTable::sortBySize (bool largestFirst)
+{
+    Array<int> order;
+
+    for (int i = 0; i < size(); ++i)
+        order.add (i);
+
+    ColumnComparator<int64> comparator (sizes.begin(), keyIndices.begin(), largestFirst);
+    order.sort (comparator);
+    reorder (order);
+}
+
+void ObjectTable::sortByLastModified (bool newestFirst)
+{
+    Array<int> order;
+
+    for (int i = 0; i < size(); ++i)
+        order.add (i);
+
+    ColumnComparator<int64> comparator (lastModified.begin(), keyIndices.begin(), newestFirst);
+    order.sort (comparator);
+    reorder (order);
+}
+
+void ObjectTable::sortByKey()
+{
+    // The key indices say where each row started out
+    Array<int> order;
+    order.insertMultiple (0, 0, size());
+
+    for (int i = 0; i < size(); ++i)
+        order.setUnchecked (keyIndices.getUnchecked (i), i);
+
+    reorder (order);
+}
+
+void ObjectTable::reorder (const Array<int>& order)
+{
+    Array<int> newKeyIndices;
+    Array<int64> newSizes, newLastModified;
+    Array<ETag> newETags;
+    Array<uint16> newETagParts;
+
+    const int numRows = order.size();
+    newKeyIndices.ensureStorageAllocated (numRows);
+    newSizes.ensureStorageAllocated (numRows);
+    newLastModified.ensureStorageAllocated (numRows);
+    newETags.ensureStorageAllocated (numRows);
+    newETagParts.ensureStorageAllocated (numRows);
+
+    for (int i = 0; i < numRows; ++i)
+    {
+        const int row = order.getUnchecked (i);
+
+        newKeyIndices.add (keyIndices.getUnchecked (row));
+        newSizes.add (sizes.getUnchecked (row));
+        newLastModified.add (lastModified.getUnchecked (row));
+        newETags.add (etags.getReference (row));
+        newETagParts.add (etagParts.getUnchecked (row));
+    }
+
+    keyIndices.swapWithArray (newKeyIndices);
+    sizes.swapWithArray (newSizes);
+    lastModified.swapWithArray (newLastModified);
+    etags.swapWithArray (newETags);
+    etagParts.swapWithArray (newETagParts);
+}
+
+//==============================================================================
+int64 ObjectTable::getMemoryUsage() const
+{
+    const int64 bytesPerRow = (int64) (sizeof (int) + sizeof (int64) * 2 + sizeof (ETag) + sizeof (uint16));
+
+    return keys.getMemoryUsage() + bytesPerRow * (int64) size();
+}
@@ -0,0 +1,95 @@
+/*
+  ==============================================================================
+
+    ObjectTable.h
+
+  ==============================================================================
+*/
+
+#ifndef __OBJECTTABLE_H_82D4F6A9__
+#define __OBJECTTABLE_H_82D4F6A9__
+
+#include "KeyTable.h"
+#include "ListBucketParser.h"
+
+
+//==============================================================================
+//==============================================================================
+/** A bucket listing kept column by column.
+
+    Each field of the listing lives in its own flat array, so a scan over
+    sizes or dates only touches those and runs straight through memory.
+    Row n's key is getKeys()[getKeyIndices()[n]]; the rows start out in key
+    order but the sorts below reorder every column together, leaving the
+    keys where they are.
+*/
+class ObjectTable
+{
+public:
+    //==============================================================================
+    ObjectTable();
+    ~ObjectTable();
+
+    //==============================================================================
+    // Entries have to arrive in key order, as they do from a listing
+    bool add (const ListBucketParser::Entry& entry);
+
+    void clear();
+
+    int size() const                            { return sizes.size(); }
+    bool isEmpty() const                        { return sizes.size() == 0; }
+
+    //==============================================================================
+    const KeyTable& getKeys() const             { return keys; }
+    String getKey (int row) const               { return keys [keyIndices [row]]; }
+
+    // The columns, size() entries each (16 bytes per row for the ETags,
+    // all zeros if there wasn't one)
+    const int* getKeyIndices() const            { return keyIndices.begin(); }
+    const int64* getSizes() const               { return sizes.begin(); }
+    const int64* getLastModified() const        { return lastModified.begin(); }
+    const uint8* getETags() const               { return reinterpret_cast <const uint8*> (etags.begin()); }
+    const uint16* getETagPartCounts() const     { return etagParts.begin(); }
+
+    const uint8* getETag (int row) const        { return etags.getReference (row).data; }
+
+    //==============================================================================
+    int64 getTotalSize() const;
+    int64 getTotalSize (int startRow, int endRow) const;
+
+    // Rows modified at or after the time given (milliseconds since 1970)
+    void findModifiedSince (int64 time, Array<int>& rows) const;
+    void findLargerThan (int64 size, Array<int>& rows) const;
+
+    void sortBySize (bool largestFirst = true);
+    void sortByLastModified (bool newestFirst = true);
+    void sortByKey();
+
+    //==============================================================================
+    int64 getMemoryUsage() const;
+
+private:
+    //==============================================================================
+    struct ETag
+    {
+        uint8 data[16];
+    };
+
+    template <class ColumnType> class ColumnComparator;
+
+    KeyTable keys;
+    Array<int> keyIndices;
+    Array<int64> sizes;
+    Array<int64> lastModified;
+    Array<ETag> etags;
+    Array<uint16> etagParts;
+
+    //==============================================================================
+    void reorder (const Array<int>& order);
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ObjectTable)
+};
+
+
+#endif  // __OBJECTTABLE_H_82D4F6A9__
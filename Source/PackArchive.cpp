@@ -0,0 +1,315 @@
+/*
+  ==============================================================================
+
+    PackArchive.cpp
+
+  ==============================================================================
+*/
+
+#include "PackArchive.h"
+
+
+//==============================================================================
+//==============================================================================
+namespace
+{
+    const char indexMagic[4] = { 'S', '3', 'P', 'K' };
+    const int indexVersion = 1;
+
+    // Offset, size and MD5, then the name and its terminating null
+    const size_t fixedMemberSize = 8 + 8 + 16;
+}
+
+//==============================================================================
+//==============================================================================
+void PackIndex::add (const String& name, int64 offset, int64 size, const MemoryBlock& md5)
+{
+    jassert (md5.getSize() == 16);
+
+    Member member;
+    member.name = name;
+    member.offset = offset;
+    member.size = size;
+    md5.copyTo (member.md5, 0, sizeof (member.md5));
+
+    members.add (member);
+}
+
+MemoryBlock PackIndex::toMemoryBlock() const
+{
+    MemoryOutputStream out;
+
+    out.write (indexMagic, sizeof (indexMagic));
+    out.writeInt (indexVersion);
+    out.writeInt (members.size());
+
+    for (int i = 0; i < members.size(); ++i)
+    {
+        const Member& member = members.getReference (i);
+
+        out.writeInt64 (member.offset);
+        out.writeInt64 (member.size);
+        out.write (member.md5, sizeof (member.md5));
+        out.writeString (member.name);
+    }
+
+    return out.getMemoryBlock();
+}
+
+bool PackIndex::loadFrom (const void* data, size_t numBytes)
+{
+    members.clear();
+
+    if (numBytes < sizeof (indexMagic) + 8 || memcmp (data, indexMagic, sizeof (indexMagic)) != 0)
+        return false;
+
+    MemoryInputStream in (data, numBytes, false);
+    in.skipNextBytes (sizeof (indexMagic));
+
+    if (in.readInt() != indexVersion)
+        return false;
+
+    const int numMembers = in.readInt();
+
+    // Each member takes at least a fixed part and a null, so a count that
+    // couldn't fit in what's left is garbage rather than a huge allocation
+    if (numMembers < 0 || numMembers > in.getNumBytesRemaining() / ((int64) fixedMemberSize + 1))
+        return false;
+
+    members.ensureStorageAllocated (numMembers);
+
+    for (int i = 0; i < numMembers; ++i)
+    {
+        if (in.getNumBytesRemaining() < (int64) fixedMemberSize + 1)
+        {
+            members.clear();
+            return false;
+        }
+
+        Member member;
+        member.offset = in.readInt64();
+        member.size = in.readInt64();
+        in.read (member.md5, sizeof (member.md5));
+        member.name = in.readString();
+
+        members.add (member);
+    }
+
+    return true;
+}
+
+
+//==============================================================================
+//==============================================================================
+PackWriter::PackWriter (AmazonS3& s3_, const String& bucket_, const String& prefix_, int64 maxPackSize_)
+    : s3 (s3_),
+      bucket (bucket_),
+      prefix (prefix_),
+      maxPackSize (maxPackSize_),
+      session (String::toHexString (Time::currentTimeMillis()).paddedLeft ('0', 12) + "-"
+                + String::toHexString (Random::getSystemRandom().nextInt()).paddedLeft ('0', 8))
+{
+}
+
+PackWriter::~PackWriter()
+{
+}
+
+//==============================================================================
+bool PackWriter::add (const String& name, const File& file)
+{
+    MemoryBlock data;
+
+    if (! file.loadFileAsData (data))
+        return false;
+
+    return add (name, data.getData(), data.getSize());
+}
+
+bool PackWriter::add (const String& name, const void* data, size_t numBytes)
+{
+    // A pack that failed to go is carried on with, and tried again
+    if (out == nullptr)
+    {
+        if (pack == nullptr)
+            pack = new TemporaryFile (".pack");
+
+        out = new FileOutputStream (pack->getFile());
+
+        if (out->failedToOpen())
+        {
+            out = nullptr;
+            return false;
+        }
+    }
+
+    const int64 offset = out->getPosition();
+
+    if (! out->write (data, (int) numBytes))
+        return false;
+
+    index.add (name, offset, (int64) numBytes, MD5 (data, numBytes).getRawChecksumData());
+
+    return out->getPosition() < maxPackSize || flushPack();
+}
+
+bool PackWriter::finish()
+{
+    return pack == nullptr || flushPack();
+}
+
+//==============================================================================
+bool PackWriter::flushPack()
+{
+    out = nullptr;
+
+    const String name (prefix + session + "-" + String (packNames.size()).paddedLeft ('0', 5));
+    bool ok = false;
+
+    // The pack goes first, an index is only ever there for a whole pack.
+    // Members are read back by byte range, so it's never gzipped.
+    {
+        S3Object object (bucket, name + ".pack");
+        ok = s3.putObject (object, pack->getFile(), false, false);
+    }
+
+    if (ok)
+    {
+        TemporaryFile indexFile (".index");
+        const MemoryBlock data (index.toMemoryBlock());
+
+        S3Object object (bucket, name + ".index");
+        ok = indexFile.getFile().replaceWithData (data.getData(), data.getSize())
+              && s3.putObject (object, indexFile.getFile());
+    }
+
+    // Everything added so far is kept for the next add() or finish() to
+    // try again, under the same name
+    if (! ok)
+        return false;
+
+    pack = nullptr;
+    index.clear();
+    packNames.add (name);
+
+    return true;
+}
+
+
+//==============================================================================
+//==============================================================================
+PackReader::PackReader (AmazonS3& s3_, const String& bucket_, const String& prefix_)
+    : s3 (s3_),
+      bucket (bucket_),
+      prefix (prefix_)
+{
+}
+
+PackReader::~PackReader()
+{
+}
+
+//==============================================================================
+bool PackReader::refresh()
+{
+    StringArray keys;
+
+    if (! s3.getDirectory (bucket, keys, prefix))
+        return false;
+
+    // Listed in key order, which is the order they were written in
+    for (int i = 0; i < keys.size(); ++i)
+    {
+        if (! keys[i].endsWith (".index"))
+            continue;
+
+        const String name (keys[i].dropLastCharacters (6));
+
+        {
+            const ScopedLock sl (lock);
+
+            if (packNames.contains (name) || badPackNames.contains (name))
+                continue;
+        }
+
+        S3Object object (bucket, keys[i]);
+        HotObjectCache::Buffer::Ptr buffer (s3.readObject (object));
+        PackIndex index;
+
+        if (buffer == nullptr)
+            return false;
+
+        const ScopedLock sl (lock);
+
+        // A damaged index would fail the same way every time, so its pack is
+        // left out rather than stopping everything after it being read
+        if (! index.loadFrom (buffer->getData(), buffer->getSize()))
+        {
+            badPackNames.addIfNotAlreadyThere (name);
+            continue;
+        }
+
+        const int pack = packNames.size();
+        packNames.add (name);
+
+        locations.ensureStorageAllocated (locations.size() + index.size());
+
+        for (int m = 0; m < index.size(); ++m)
+        {
+            const PackIndex::Member& member = index[m];
+
+            Location location;
+            location.pack = pack;
+            location.offset = member.offset;
+            location.size = member.size;
+            memcpy (location.md5, member.md5, sizeof (location.md5));
+
+            locationIndex.set (member.name, locations.size());
+            locations.add (location);
+        }
+    }
+
+    return true;
+}
+
+bool PackReader::contains (const String& name) const
+{
+    const ScopedLock sl (lock);
+    return locationIndex.contains (name);
+}
+
+int PackReader::getNumMembers() const
+{
+    const ScopedLock sl (lock);
+    return locationIndex.size();
+}
+
+StringArray PackReader::getBadPackNames() const
+{
+    const ScopedLock sl (lock);
+    return badPackNames;
+}
+
+//==============================================================================
+bool PackReader::read (const String& name, MemoryBlock& data)
+{
+    Location location;
+    String packName;
+
+    {
+        const ScopedLock sl (lock);
+
+        if (! locationIndex.contains (name))
+            return false;
+
+        location = locations.getReference (locationIndex [name]);
+        packName = packNames [location.pack];
+    }
+
+    S3Object object (bucket, packName + ".pack");
+
+    if (! s3.readRange (object, location.offset, location.size, data))
+        return false;
+
+    return MD5 (data).getRawChecksumData() == MemoryBlock (location.md5, sizeof (location.md5));
+}
@@ -0,0 +1,176 @@
+/*
+  ==============================================================================
+
+    PackArchive.h
+
+  ==============================================================================
+*/
+
+#ifndef __PACKARCHIVE_H_9A2C61E8__
+#define __PACKARCHIVE_H_9A2C61E8__
+
+#include "AmazonS3.h"
+
+
+//==============================================================================
+//==============================================================================
+/** Where each member of one pack sits.
+
+    A pack is two objects: "<name>.pack", the members' bytes one after
+    another, and "<name>.index", this, which gives each member's offset,
+    size and MD5.  The index is written after the pack, so if it's there the
+    pack is complete.
+*/
+class PackIndex
+{
+public:
+    //==============================================================================
+    struct Member
+    {
+        String name;
+        int64 offset;
+        int64 size;
+        uint8 md5[16];
+    };
+
+    //==============================================================================
+    PackIndex() {}
+    ~PackIndex() {}
+
+    //==============================================================================
+    void add (const String& name, int64 offset, int64 size, const MemoryBlock& md5);
+    void clear()                                { members.clear(); }
+
+    int size() const                            { return members.size(); }
+    const Member& operator[] (int index) const  { return members.getReference (index); }
+
+    //==============================================================================
+    MemoryBlock toMemoryBlock() const;
+
+    // False if it isn't an index, or is cut short
+    bool loadFrom (const void* data, size_t numBytes);
+
+private:
+    //==============================================================================
+    Array<Member> members;
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PackIndex)
+};
+
+
+//==============================================================================
+//==============================================================================
+/** Bundles lots of small files into a few big objects.
+
+    Members are appended to a local pack file until it reaches the size
+    limit, then the pack and its index are put as two objects under the
+    prefix, so a thousand small files cost two requests rather than a
+    thousand.  Each writer names its packs after the time it was created,
+    so packs written later sort later.
+
+    @code
+    PackWriter writer (s3, "bucket", "telemetry/");
+
+    for (int i = 0; i < files.size(); ++i)
+        writer.add (files[i].getFileName(), files[i]);
+
+    writer.finish();
+    @endcode
+*/
+class PackWriter
+{
+public:
+    //==============================================================================
+    PackWriter (AmazonS3& s3, const String& bucket, const String& prefix,
+                int64 maxPackSize = 256 * 1024 * 1024);
+
+    // Anything not yet put by finish() is lost
+    ~PackWriter();
+
+    //==============================================================================
+    bool add (const String& name, const File& file);
+    bool add (const String& name, const void* data, size_t numBytes);
+
+    // Puts the pack that's being filled.  If a pack fails to go, whether
+    // here or when add() fills one, it's kept along with everything in it,
+    // and the next add() or finish() tries again.
+    bool finish();
+
+    // The packs put so far, without the ".pack"
+    const StringArray& getPackNames() const     { return packNames; }
+
+private:
+    //==============================================================================
+    AmazonS3& s3;
+    const String bucket, prefix;
+    const int64 maxPackSize;
+    const String session;
+
+    ScopedPointer<TemporaryFile> pack;
+    ScopedPointer<FileOutputStream> out;
+    PackIndex index;
+    StringArray packNames;
+
+    //==============================================================================
+    bool flushPack();
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PackWriter)
+};
+
+
+//==============================================================================
+//==============================================================================
+/** Reads members out of the packs under a prefix.
+
+    refresh() lists the prefix and loads any index it hasn't seen yet,
+    after that each read is a single ranged GET.  Where a name is in more
+    than one pack the one from the latest pack wins.
+
+    The indexes are read with AmazonS3::readObject, so with an object cache
+    they're kept on disk between runs too.
+*/
+class PackReader
+{
+public:
+    //==============================================================================
+    PackReader (AmazonS3& s3, const String& bucket, const String& prefix);
+    ~PackReader();
+
+    //==============================================================================
+    bool refresh();
+
+    bool contains (const String& name) const;
+    int getNumMembers() const;
+
+    // Packs whose index couldn't be read, which refresh() leaves out
+    StringArray getBadPackNames() const;
+
+    // Checked against the MD5 in the index
+    bool read (const String& name, MemoryBlock& data);
+
+private:
+    //==============================================================================
+    struct Location
+    {
+        int pack;
+        int64 offset;
+        int64 size;
+        uint8 md5[16];
+    };
+
+    AmazonS3& s3;
+    const String bucket, prefix;
+
+    StringArray packNames, badPackNames;
+    HashMap<String, int> locationIndex;
+    Array<Location> locations;
+    CriticalSection lock;
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PackReader)
+};
+
+
+#endif  // __PACKARCHIVE_H_9A2C61E8__
@@ -0,0 +1,387 @@
+/*
+  ==============================================================================
+
+    ParallelBucketListing.cpp
+
+  ==============================================================================
+*/
+
+#include "ParallelBucketListing.h"
+
+
+//==============================================================================
+//==============================================================================
+namespace
+{
+    // Fallback split points after the prefix, for buckets with no delimiter
+    // structure to go on
+    const char* const splitCharacters = "-./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz";
+
+    // How far down a single prefix like "data/2024/" is followed
+    const int maxProbeDepth = 4;
+}
+
+//==============================================================================
+class ParallelBucketListing::PageCollector  : public ListBucketParser::Listener
+{
+public:
+    PageCollector (Page& page_, const String& upTo_)
+        : page (page_), upTo (upTo_), passedEnd (false) {}
+
+    void listEntry (const ListBucketParser::Entry& entry)
+    {
+        if (isInRange (entry.key))
+            page.entries.add (entry);
+    }
+
+    void listCommonPrefix (const String& prefix)
+    {
+        if (isInRange (prefix))
+            page.prefixes.add (prefix);
+    }
+
+    bool hasPassedEnd() const   { return passedEnd; }
+
+private:
+    Page& page;
+    const String upTo;
+    bool passedEnd;
+
+    bool isInRange (const String& key)
+    {
+        if (upTo.isEmpty() || key.compare (upTo) <= 0)
+            return true;
+
+        passedEnd = true;
+        return false;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (PageCollector);
+};
+
+//==============================================================================
+class ParallelBucketListing::Worker  : public Thread
+{
+public:
+    Worker (ParallelBucketListing& owner_)
+        : Thread ("S3 parallel listing"), owner (owner_) {}
+
+    void run()
+    {
+        while (! threadShouldExit())
+        {
+            bool allClaimed = false;
+            Range* range = owner.claimRange (allClaimed);
+
+            if (range != nullptr)
+                owner.listRange (*range);
+            else if (allClaimed)
+                return;
+            else
+                wait (-1);  // too far ahead of the caller, woken as it catches up
+        }
+    }
+
+private:
+    ParallelBucketListing& owner;
+
+    JUCE_DECLARE_NON_COPYABLE (Worker);
+};
+
+
+//==============================================================================
+//==============================================================================
+ParallelBucketListing::ParallelBucketListing (AmazonS3& s3_, const String& bucket_,
+                                              const AmazonS3::ListOptions& options_,
+                                              int numThreads_, Ordering ordering_)
+    : s3 (s3_),
+      bucket (bucket_),
+      options (options_),
+      numThreads (jmax (1, numThreads_)),
+      ordering (ordering_),
+      nextRange (0),
+      emitRange (0),
+      cancelled (false)
+{
+}
+
+ParallelBucketListing::~ParallelBucketListing()
+{
+    stopWorkers();
+}
+
+//==============================================================================
+bool ParallelBucketListing::list (ListBucketParser::Listener& listener)
+{
+    stopWorkers();
+
+    nextRange = 0;
+    emitRange = 0;
+    cancelled = false;
+    error = String::empty;
+
+    if (! findRanges())
+        return false;
+
+    for (int n = jmin (numThreads, ranges.size()); --n >= 0;)
+    {
+        Worker* const worker = new Worker (*this);
+        workers.add (worker);
+        worker->startThread();
+    }
+
+    for (;;)
+    {
+        OwnedArray<Page> taken;
+        bool finished = true;
+        bool advanced = false;
+
+        {
+            const ScopedLock sl (lock);
+
+            if (error.isNotEmpty())
+                break;
+
+            if (ordering == sorted)
+            {
+                // Only the range at the cursor may be emitted, later ones wait
+                if (emitRange < ranges.size())
+                {
+                    Range& range = *ranges.getUnchecked (emitRange);
+
+                    while (range.pages.size() > 0)
+                        taken.add (range.pages.removeAndReturn (0));
+
+                    if (range.done)
+                    {
+                        ++emitRange;
+                        advanced = true;
+                    }
+
+                    finished = false;
+                }
+            }
+            else
+            {
+                for (int n = 0; n < ranges.size(); ++n)
+                {
+                    Range& range = *ranges.getUnchecked (n);
+
+                    while (range.pages.size() > 0)
+                        taken.add (range.pages.removeAndReturn (0));
+
+                    finished = finished && range.done;
+                }
+            }
+        }
+
+        emit (taken, listener);
+
+        if (advanced)
+        {
+            for (int n = workers.size(); --n >= 0;)
+                workers.getUnchecked (n)->notify();
+
+            continue;
+        }
+
+        if (finished)
+            break;
+
+        if (taken.size() == 0)
+            dataReady.wait();
+    }
+
+    stopWorkers();
+    return getError().isEmpty();
+}
+
+String ParallelBucketListing::getError() const
+{
+    const ScopedLock sl (lock);
+    return error;
+}
+
+//==============================================================================
+bool ParallelBucketListing::findRanges()
+{
+    ranges.clear();
+
+    if (options.delimiter.isNotEmpty())
+    {
+        ranges.add (new Range (options.startAfter, String::empty));
+        return true;
+    }
+
+    // Common prefixes are natural split points.  While there are too few
+    // of them to go round the threads, each is probed for the prefixes
+    // below it, so a bucket that's all under "data/2024/" still splits.
+    StringArray boundaries, level;
+    level.add (options.prefix);
+
+    for (int depth = 0; depth < maxProbeDepth && level.size() > 0 && level.size() < numThreads; ++depth)
+    {
+        StringArray below;
+
+        for (int n = 0; n < level.size(); ++n)
+        {
+            Page page;
+            bool truncated = false;
+
+            if (! probe (level[n], page, truncated))
+                return false;
+
+            boundaries.addArray (page.prefixes);
+            below.addArray (page.prefixes);
+
+            // Lots of keys straight under this prefix and no structure to
+            // go on, so it's cut by the next character of the name
+            if (truncated && page.prefixes.size() < numThreads)
+                for (const char* c = splitCharacters; *c != 0; ++c)
+                    boundaries.add (level[n] + String::charToString ((juce_wchar) (uint8) *c));
+        }
+
+        level = below;
+    }
+
+    boundaries.sort (false);
+    boundaries.removeDuplicates (false);
+
+    String after (options.startAfter);
+
+    for (int n = 0; n < boundaries.size(); ++n)
+    {
+        if (after.isNotEmpty() && boundaries[n].compare (after) <= 0)
+            continue;
+
+        ranges.add (new Range (after, boundaries[n]));
+        after = boundaries[n];
+    }
+
+    ranges.add (new Range (after, String::empty));
+    return true;
+}
+
+bool ParallelBucketListing::probe (const String& prefix, Page& page, bool& truncated)
+{
+    AmazonS3::ListOptions probeOptions (options);
+    probeOptions.prefix = prefix;
+    probeOptions.delimiter = "/";
+    probeOptions.startAfter = String::empty;
+
+    PageCollector collector (page, String::empty);
+    ListBucketParser parser (collector);
+
+    if (! s3.listObjects (bucket, probeOptions, String::empty, parser))
+    {
+        error = parser.getErrorCode().isNotEmpty() ? parser.getErrorCode() + ": " + parser.getErrorMessage()
+                                                   : String ("List request failed");
+        return false;
+    }
+
+    truncated = parser.isTruncated();
+    return true;
+}
+
+//==============================================================================
+ParallelBucketListing::Range* ParallelBucketListing::claimRange (bool& allClaimed)
+{
+    const ScopedLock sl (lock);
+
+    allClaimed = cancelled || nextRange >= ranges.size();
+
+    if (allClaimed)
+        return nullptr;
+
+    // Sorted output has to buffer everything past the cursor, so don't let
+    // the workers get too far ahead of it
+    if (ordering == sorted && nextRange >= emitRange + numThreads * 2)
+        return nullptr;
+
+    return ranges.getUnchecked (nextRange++);
+}
+
+bool ParallelBucketListing::listRange (Range& range)
+{
+    AmazonS3::ListOptions rangeOptions (options);
+    rangeOptions.startAfter = range.after;
+
+    String continuationToken;
+
+    for (;;)
+    {
+        {
+            const ScopedLock sl (lock);
+
+            if (cancelled)
+                return false;
+        }
+
+        ScopedPointer<Page> page (new Page());
+        PageCollector collector (*page, range.upTo);
+        ListBucketParser parser (collector);
+
+        if (! s3.listObjects (bucket, rangeOptions, continuationToken, parser))
+        {
+            const ScopedLock sl (lock);
+
+            if (error.isEmpty())
+                error = parser.getErrorCode().isNotEmpty() ? parser.getErrorCode() + ": " + parser.getErrorMessage()
+                                                           : String ("List request failed");
+            cancelled = true;
+            dataReady.signal();
+            return false;
+        }
+
+        continuationToken = parser.getNextContinuationToken();
+
+        const bool reachedEnd = collector.hasPassedEnd() || ! parser.isTruncated() || continuationToken.isEmpty();
+
+        {
+            const ScopedLock sl (lock);
+
+            range.pages.add (page.release());
+            range.done = reachedEnd;
+        }
+
+        dataReady.signal();
+
+        if (reachedEnd)
+            return true;
+    }
+}
+
+//==============================================================================
+void ParallelBucketListing::emit (OwnedArray<Page>& pages, ListBucketParser::Listener& listener)
+{
+    for (int p = 0; p < pages.size(); ++p)
+    {
+        const Page& page = *pages.getUnchecked (p);
+
+        for (int n = 0; n < page.entries.size(); ++n)
+            listener.listEntry (page.entries.getReference (n));
+
+        for (int n = 0; n < page.prefixes.size(); ++n)
+            listener.listCommonPrefix (page.prefixes[n]);
+    }
+}
+
+void ParallelBucketListing::stopWorkers()
+{
+    {
+        const ScopedLock sl (lock);
+        cancelled = true;
+    }
+
+    for (int n = workers.size(); --n >= 0;)
+    {
+        workers.getUnchecked (n)->signalThreadShouldExit();
+        workers.getUnchecked (n)->notify();
+    }
+
+    // Requests in flight are left to finish
+    for (int n = workers.size(); --n >= 0;)
+        workers.getUnchecked (n)->stopThread (-1);
+
+    workers.clear();
+}
@@ -0,0 +1,106 @@
+/*
+  ==============================================================================
+
+    ParallelBucketListing.h
+
+  ==============================================================================
+*/
+
+#ifndef __PARALLELBUCKETLISTING_H_5B7C19E2__
+#define __PARALLELBUCKETLISTING_H_5B7C19E2__
+
+#include "AmazonS3.h"
+
+
+//==============================================================================
+//==============================================================================
+/** Lists a big bucket over several connections at once.
+
+    The key space is cut into ranges at split points found with delimiter
+    queries (the common prefixes, followed down while there are fewer of
+    them than threads), plus single character split points wherever lots
+    of keys sit flat under one prefix.  Each range is listed with start-after
+    on its own worker thread, stopping at the range's upper bound.
+
+    Entries are handed to the listener on the calling thread, either in key
+    order (ranges are emitted in turn, later ones buffered, with workers
+    kept a bounded number of ranges ahead) or as soon as any page arrives.
+*/
+class ParallelBucketListing
+{
+public:
+    //==============================================================================
+    enum Ordering
+    {
+        sorted = 0,
+        unordered
+    };
+
+    ParallelBucketListing (AmazonS3& s3, const String& bucket,
+                           const AmazonS3::ListOptions& options = AmazonS3::ListOptions(),
+                           int numThreads = 8, Ordering ordering = sorted);
+
+    ~ParallelBucketListing();
+
+    //==============================================================================
+    // Blocks until everything has been listed or a request fails.  A
+    // delimiter in the options lists on one connection, since prefixes
+    // could straddle the ranges.
+    bool list (ListBucketParser::Listener& listener);
+
+    String getError() const;
+
+    int getNumRanges() const        { return ranges.size(); }
+
+private:
+    //==============================================================================
+    struct Page
+    {
+        Array<ListBucketParser::Entry> entries;
+        StringArray prefixes;
+    };
+
+    // Keys in (after, upTo], an empty upTo is open ended
+    struct Range
+    {
+        Range (const String& after_, const String& upTo_) : after (after_), upTo (upTo_), done (false) {}
+
+        String after, upTo;
+        OwnedArray<Page> pages;
+        bool done;
+    };
+
+    class Worker;
+    class PageCollector;
+    friend class Worker;
+
+    //==============================================================================
+    AmazonS3& s3;
+    const String bucket;
+    const AmazonS3::ListOptions options;
+    const int numThreads;
+    const Ordering ordering;
+
+    OwnedArray<Range> ranges;
+    OwnedArray<Worker> workers;
+    int nextRange, emitRange;
+    bool cancelled;
+    String error;
+
+    CriticalSection lock;
+    WaitableEvent dataReady;
+
+    //==============================================================================
+    bool findRanges();
+    bool probe (const String& prefix, Page& page, bool& truncated);
+    bool listRange (Range& range);
+    Range* claimRange (bool& allClaimed);
+    void emit (OwnedArray<Page>& pages, ListBucketParser::Listener& listener);
+    void stopWorkers();
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ParallelBucketListing)
+};
+
+
+#endif  // __PARALLELBUCKETLISTING_H_5B7C19E2__
@@ -0,0 +1,281 @@
+/*
+  ==============================================================================
+
+    ParallelGZIPOutputStream.cpp
+
+  ==============================================================================
+*/
+
+#include "ParallelGZIPOutputStream.h"
+
+// The zlib that's built into juce_core, which GZIPCompressorOutputStream
+// keeps to itself
+namespace juce
+{
+    namespace zlibNamespace
+    {
+       #if JUCE_INCLUDE_ZLIB_CODE
+        #undef OS_CODE
+        #undef fdopen
+        #include "../JuceLibraryCode/modules/juce_core/zip/zlib/zlib.h"
+       #else
+        #include JUCE_ZLIB_INCLUDE_PATH
+       #endif
+    }
+}
+
+
+//==============================================================================
+//==============================================================================
+namespace
+{
+    // Deflate can't look further back than this
+    const int dictionarySize = 32768;
+}
+
+//==============================================================================
+struct ParallelGZIPOutputStream::Block
+{
+    Block (int size)
+        : input ((size_t) size), numIn (0), numOut (0), crc (0),
+          isLast (false), done (false), failed (false) {}
+
+    // Deflates the input raw, ending on a byte boundary unless it's the
+    // last block, which ends the stream
+    void compress (int level)
+    {
+        using namespace zlibNamespace;
+
+        crc = (uint32) crc32 (0, (const Bytef*) input.getData(), (uInt) numIn);
+
+        z_stream stream;
+        zerostruct (stream);
+
+        if (deflateInit2 (&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            failed = true;
+            return;
+        }
+
+        if (dictionary.getSize() > 0)
+            deflateSetDictionary (&stream, (const Bytef*) dictionary.getData(), (uInt) dictionary.getSize());
+
+        // Room for the sync marker on top of the worst case
+        output.setSize ((size_t) deflateBound (&stream, (uLong) numIn) + 16);
+
+        stream.next_in = (Bytef*) input.getData();
+        stream.avail_in = (uInt) numIn;
+
+        for (;;)
+        {
+            stream.next_out = (Bytef*) output.getData() + numOut;
+            stream.avail_out = (uInt) (output.getSize() - (size_t) numOut);
+
+            const int result = deflate (&stream, isLast ? Z_FINISH : Z_SYNC_FLUSH);
+            numOut = (int) (output.getSize() - stream.avail_out);
+
+            if (result == Z_STREAM_END || (result == Z_OK && stream.avail_out > 0 && ! isLast))
+                break;
+
+            if (result != Z_OK && result != Z_BUF_ERROR)
+            {
+                failed = true;
+                break;
+            }
+
+            output.setSize (output.getSize() * 2);
+        }
+
+        deflateEnd (&stream);
+    }
+
+    MemoryBlock input, dictionary, output;
+    int numIn, numOut;
+    uint32 crc;
+    bool isLast, done, failed;
+
+    JUCE_DECLARE_NON_COPYABLE (Block);
+};
+
+//==============================================================================
+class ParallelGZIPOutputStream::CompressJob  : public WorkQueue::Job
+{
+public:
+    CompressJob (ParallelGZIPOutputStream& owner_, Block& block_)
+        : owner (owner_), block (block_) {}
+
+    void run()
+    {
+        block.compress (owner.compressionLevel);
+
+        {
+            const ScopedLock sl (owner.lock);
+            block.done = true;
+        }
+
+        owner.blockDone.signal();
+    }
+
+private:
+    ParallelGZIPOutputStream& owner;
+    Block& block;
+
+    JUCE_DECLARE_NON_COPYABLE (CompressJob);
+};
+
+
+//==============================================================================
+//==============================================================================
+ParallelGZIPOutputStream::ParallelGZIPOutputStream (OutputStream* destStream_, int compressionLevel_,
+                                                    bool deleteDestStream, int numThreads, int blockSize_)
+    : destStream (destStream_, deleteDestStream),
+      compressionLevel ((compressionLevel_ < 1 || compressionLevel_ > 9) ? -1 : compressionLevel_),
+      blockSize (jmax (1024, blockSize_)),
+      maxBlocks (2 * (numThreads > 0 ? numThreads : SystemStats::getNumCpus())),
+      // Never more jobs than blocks in flight, so adding one doesn't wait
+      compressor ("Parallel gzip", maxBlocks / 2, maxBlocks),
+      totalIn (0),
+      crc (0),
+      finished (false),
+      ok (true)
+{
+    jassert (destStream_ != nullptr);
+
+    // No name, time or flags, and an unknown OS
+    const uint8 header[] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 255 };
+    ok = destStream->write (header, sizeof (header));
+}
+
+ParallelGZIPOutputStream::~ParallelGZIPOutputStream()
+{
+    flush();
+    compressor.finish();
+}
+
+//==============================================================================
+void ParallelGZIPOutputStream::flush()
+{
+    if (finished)
+        return;
+
+    finished = true;
+    queueCurrent (true);
+    writeFinishedBlocks (true);
+
+    // CRC and length, both little-endian
+    uint8 trailer[8];
+    *(uint32*) trailer = ByteOrder::swapIfBigEndian (crc);
+    *(uint32*) (trailer + 4) = ByteOrder::swapIfBigEndian ((uint32) totalIn);
+
+    ok = ok && destStream->write (trailer, sizeof (trailer));
+
+    destStream->flush();
+}
+
+bool ParallelGZIPOutputStream::write (const void* data, int numBytes)
+{
+    // It's already been flushed and closed
+    jassert (! finished);
+
+    if (finished)
+        return false;
+
+    const char* source = static_cast<const char*> (data);
+
+    while (numBytes > 0 && ok)
+    {
+        if (current == nullptr)
+            current = new Block (blockSize);
+
+        const int numToCopy = jmin (numBytes, blockSize - current->numIn);
+        memcpy (static_cast<char*> (current->input.getData()) + current->numIn, source, (size_t) numToCopy);
+
+        current->numIn += numToCopy;
+        totalIn += numToCopy;
+        source += numToCopy;
+        numBytes -= numToCopy;
+
+        if (current->numIn == blockSize)
+        {
+            queueCurrent (false);
+            writeFinishedBlocks (false);
+        }
+    }
+
+    return ok;
+}
+
+uint32 ParallelGZIPOutputStream::updateCRC (uint32 crc, const void* data, size_t numBytes) noexcept
+{
+    return (uint32) zlibNamespace::crc32 (crc, static_cast<const zlibNamespace::Bytef*> (data), (zlibNamespace::uInt) numBytes);
+}
+
+//==============================================================================
+void ParallelGZIPOutputStream::queueCurrent (bool isLast)
+{
+    if (current == nullptr)
+        current = new Block (0);
+
+    current->isLast = isLast;
+    current->dictionary = previousTail;
+
+    // The next block's dictionary, which may reach back past this one if
+    // it's short
+    previousTail.append (current->input.getData(), (size_t) current->numIn);
+
+    if (previousTail.getSize() > (size_t) dictionarySize)
+        previousTail.removeSection (0, previousTail.getSize() - (size_t) dictionarySize);
+
+    // Something that never filled a block is done on this thread,
+    // without starting any others
+    if (isLast && current->numIn == totalIn)
+    {
+        current->compress (compressionLevel);
+        current->done = true;
+    }
+
+    Block* const block = current.release();
+    const bool needsCompressing = ! block->done;
+
+    {
+        const ScopedLock sl (lock);
+        blocks.add (block);
+    }
+
+    if (needsCompressing)
+        compressor.add (new CompressJob (*this, *block));
+}
+
+bool ParallelGZIPOutputStream::writeFinishedBlocks (bool waitForAll)
+{
+    for (;;)
+    {
+        ScopedPointer<Block> block;
+
+        {
+            const ScopedLock sl (lock);
+
+            if (blocks.size() == 0)
+                return ok;
+
+            if (blocks.getFirst()->done)
+                block = blocks.removeAndReturn (0);
+            else if (! waitForAll && blocks.size() < maxBlocks)
+                return ok;
+        }
+
+        if (block == nullptr)
+        {
+            blockDone.wait (-1);
+            continue;
+        }
+
+        if (block->failed)
+            ok = false;
+
+        if (ok)
+            ok = destStream->write (block->output.getData(), block->numOut);
+
+        crc = (uint32) zlibNamespace::crc32_combine (crc, block->crc, (z_off_t) block->numIn);
+    }
+}
@@ -0,0 +1,90 @@
+/*
+  ==============================================================================
+
+    ParallelGZIPOutputStream.h
+
+  ==============================================================================
+*/
+
+#ifndef __PARALLELGZIPOUTPUTSTREAM_H_6E3B90D2__
+#define __PARALLELGZIPOUTPUTSTREAM_H_6E3B90D2__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "WorkQueue.h"
+
+
+//==============================================================================
+//==============================================================================
+/** Writes gzip, using all the cores.
+
+    The input is cut into blocks which are deflated on several threads at
+    once, each primed with the last 32K of the block before it so the ratio
+    is about what a single stream gets.  Every block but the last ends on a
+    byte boundary, so they join up as they are into one ordinary gzip
+    member, whose CRC is put together from the blocks'.
+
+    Blocks are written out in order as they finish, and only a few are held
+    per thread, write() blocks while the threads catch up.
+
+    As with GZIPCompressorOutputStream, flush() finishes the stream, nothing
+    more can be written after it.
+*/
+class ParallelGZIPOutputStream  : public OutputStream
+{
+public:
+    //==============================================================================
+    // A numThreads of 0 uses one per CPU
+    ParallelGZIPOutputStream (OutputStream* destStream,
+                              int compressionLevel = 6,
+                              bool deleteDestStreamWhenDestroyed = false,
+                              int numThreads = 0,
+                              int blockSize = 128 * 1024);
+
+    ~ParallelGZIPOutputStream();
+
+    //==============================================================================
+    void flush();
+
+    // The number of bytes written in, not out
+    int64 getPosition()                         { return totalIn; }
+    bool setPosition (int64)                    { return false; }
+    bool write (const void* data, int numBytes);
+
+    //==============================================================================
+    // The CRC-32 a gzip trailer holds, carried on from crc over more data
+    static uint32 updateCRC (uint32 crc, const void* data, size_t numBytes) noexcept;
+
+private:
+    //==============================================================================
+    struct Block;
+    class CompressJob;
+    friend class CompressJob;
+
+    //==============================================================================
+    OptionalScopedPointer<OutputStream> destStream;
+    const int compressionLevel;
+    const int blockSize;
+    const int maxBlocks;
+
+    ScopedPointer<Block> current;
+    MemoryBlock previousTail;
+
+    OwnedArray<Block> blocks;       // in flight, in order
+    WorkQueue compressor;
+    CriticalSection lock;
+    WaitableEvent blockDone;
+
+    int64 totalIn;
+    uint32 crc;
+    bool finished, ok;
+
+    //==============================================================================
+    void queueCurrent (bool isLast);
+    bool writeFinishedBlocks (bool waitForAll);
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ParallelGZIPOutputStream)
+};
+
+
+#endif  // __PARALLELGZIPOUTPUTSTREAM_H_6E3B90D2__
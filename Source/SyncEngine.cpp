@@ -0,0 +1,541 @@
+/*
+  ==============================================================================
+
+    SyncEngine.cpp
+
+  ==============================================================================
+*/
+
+#include "SyncEngine.h"
+#include "BucketListing.h"
+#include "BatchDelete.h"
+
+#if JUCE_WINDOWS
+ #include <io.h>
+#else
+ #include <dirent.h>
+#endif
+
+
+//==============================================================================
+//==============================================================================
+class SyncEngine::KeyComparator
+{
+public:
+    // Code point order, which is the byte order of the UTF-8 that S3 sorts by
+    static int compareElements (const LocalFile& first, const LocalFile& second)
+    {
+        return first.key.compare (second.key);
+    }
+};
+
+//==============================================================================
+// Counts the remote deletes as their batches come back
+class SyncEngine::DeleteResults  : public AmazonS3::DeleteListener
+{
+public:
+    DeleteResults (SyncEngine& owner_) : owner (owner_) {}
+
+    void objectDeleted (const String&)
+    {
+        const ScopedLock sl (owner.lock);
+        ++owner.stats.numDeleted;
+    }
+
+    void deleteFailed (const String& key, const String&)
+    {
+        const ScopedLock sl (owner.lock);
+        owner.failedKeys.add (key);
+        ++owner.stats.numFailed;
+    }
+
+private:
+    SyncEngine& owner;
+
+    JUCE_DECLARE_NON_COPYABLE (DeleteResults);
+};
+
+//==============================================================================
+class SyncEngine::ScanWorker  : public Thread
+{
+public:
+    ScanWorker (SyncEngine& owner_)
+        : Thread ("S3 sync scan"), owner (owner_) {}
+
+    void run()
+    {
+        Array<LocalFile> results;
+        File dir;
+
+        while (! threadShouldExit() && owner.claimScanDirectory (dir))
+            owner.scanDirectory (dir, true, results);
+
+        const ScopedLock sl (owner.lock);
+        owner.localFiles.addArray (results);
+    }
+
+private:
+    SyncEngine& owner;
+
+    JUCE_DECLARE_NON_COPYABLE (ScanWorker);
+};
+
+//==============================================================================
+class SyncEngine::TransferJob  : public WorkQueue::Job
+{
+public:
+    TransferJob (SyncEngine& owner_, const Task& task_)
+        : owner (owner_), task (task_) {}
+
+    void run()      { owner.runTask (task); }
+
+private:
+    SyncEngine& owner;
+    const Task task;
+
+    JUCE_DECLARE_NON_COPYABLE (TransferJob);
+};
+
+
+//==============================================================================
+//==============================================================================
+SyncEngine::SyncEngine (AmazonS3& s3_, const String& bucket_, const String& prefix_,
+                        const File& directory_, Direction direction_, int numThreads_)
+    : s3 (s3_),
+      bucket (bucket_),
+      prefix (prefix_),
+      directory (directory_),
+      direction (direction_),
+      numThreads (jmax (1, numThreads_)),
+      deleteExtraneous (false),
+      nextScanDirectory (0),
+      scanComplete (false),
+      // The queue is kept short so the merge can't get far ahead of the
+      // transfers, however many files need sending
+      transfers ("S3 sync transfer", numThreads_, 4 * jmax (1, numThreads_))
+{
+    if (prefix.isNotEmpty() && ! prefix.endsWithChar ('/'))
+        prefix << '/';
+}
+
+SyncEngine::~SyncEngine()
+{
+    transfers.finish();
+}
+
+//==============================================================================
+bool SyncEngine::run()
+{
+    {
+        const ScopedLock sl (lock);
+        stats = Stats();
+        failedKeys.clear();
+        extraneousKeys.clear();
+        error = String::empty;
+    }
+
+    if (! directory.isDirectory())
+    {
+        if (direction == upload || ! directory.createDirectory())
+        {
+            const ScopedLock sl (lock);
+            error = "Can't open " + directory.getFullPathName();
+            return false;
+        }
+    }
+
+    // Uploads still go if some of the tree couldn't be read, but nothing
+    // is deleted on the strength of it
+    scanLocal();
+
+    DeleteResults deleteResults (*this);
+
+    if (direction == upload && deleteExtraneous && scanComplete)
+        remoteDeleter = new BatchDelete (s3, bucket, deleteResults);
+
+    const bool merged = merge();
+    transfers.finish();
+
+    if (remoteDeleter != nullptr)
+    {
+        remoteDeleter->finish();
+        remoteDeleter = nullptr;
+    }
+
+    localFiles.clear();
+
+    return merged && scanComplete && stats.numFailed == 0;
+}
+
+//==============================================================================
+SyncEngine::Stats SyncEngine::getStats() const
+{
+    const ScopedLock sl (lock);
+    return stats;
+}
+
+StringArray SyncEngine::getFailedKeys() const
+{
+    const ScopedLock sl (lock);
+    return failedKeys;
+}
+
+StringArray SyncEngine::getExtraneousKeys() const
+{
+    const ScopedLock sl (lock);
+    return extraneousKeys;
+}
+
+String SyncEngine::getError() const
+{
+    const ScopedLock sl (lock);
+    return error;
+}
+
+//==============================================================================
+bool SyncEngine::scanLocal()
+{
+    localFiles.clearQuick();
+    scanDirectories.clearQuick();
+    nextScanDirectory = 0;
+    scanComplete = true;
+
+    // Files at the top go straight in, each directory below is walked on
+    // whichever scan thread claims it
+    scanDirectory (directory, false, localFiles);
+
+    OwnedArray<ScanWorker> workers;
+
+    for (int n = jmin (numThreads, scanDirectories.size()); --n >= 0;)
+    {
+        ScanWorker* const worker = new ScanWorker (*this);
+        workers.add (worker);
+        worker->startThread();
+    }
+
+    for (int n = 0; n < workers.size(); ++n)
+        workers.getUnchecked (n)->waitForThreadToExit (-1);
+
+    KeyComparator comparator;
+    localFiles.sort (comparator);
+
+    const ScopedLock sl (lock);
+    stats.numLocal = localFiles.size();
+    return scanComplete;
+}
+
+void SyncEngine::scanDirectory (const File& dir, bool recursive, Array<LocalFile>& results)
+{
+    // DirectoryIterator quietly skips anything it can't open, which would
+    // make everything under it look deleted
+    if (! canReadDirectory (dir))
+    {
+        scanFailed (dir);
+        return;
+    }
+
+    const int rootLength = directory.getFullPathName().length() + 1;
+
+    // Directories have to be asked for too, otherwise the iterator loses the
+    // size and date of the first file it finds in each one
+    DirectoryIterator iter (dir, recursive, "*", File::findFilesAndDirectories);
+
+    bool isDir = false;
+    int64 size = 0;
+    Time modified;
+
+    while (iter.next (&isDir, nullptr, &size, &modified, nullptr, nullptr))
+    {
+        if (isDir)
+        {
+            if (! recursive)
+            {
+                const ScopedLock sl (lock);
+                scanDirectories.add (iter.getFile());
+            }
+            else if (! canReadDirectory (iter.getFile()))
+            {
+                scanFailed (iter.getFile());
+            }
+
+            continue;
+        }
+
+        LocalFile local;
+        local.key = iter.getFile().getFullPathName().substring (rootLength);
+        local.size = size;
+        local.modified = modified.toMilliseconds();
+
+        if (File::separator != '/')
+            local.key = local.key.replaceCharacter (File::separator, '/');
+
+        results.add (local);
+    }
+}
+
+bool SyncEngine::canReadDirectory (const File& dir)
+{
+   #if JUCE_WINDOWS
+    // Even an empty directory has "." in it
+    _wfinddata_t data;
+    const intptr_t handle = _wfindfirst (dir.getChildFile ("*").getFullPathName().toWideCharPointer(), &data);
+
+    if (handle == -1)
+        return false;
+
+    _findclose (handle);
+   #else
+    DIR* const handle = opendir (dir.getFullPathName().toUTF8());
+
+    if (handle == nullptr)
+        return false;
+
+    closedir (handle);
+   #endif
+
+    return true;
+}
+
+void SyncEngine::scanFailed (const File& dir)
+{
+    const ScopedLock sl (lock);
+    scanComplete = false;
+    error = "Can't read " + dir.getFullPathName();
+}
+
+bool SyncEngine::claimScanDirectory (File& dir)
+{
+    const ScopedLock sl (lock);
+
+    if (nextScanDirectory >= scanDirectories.size())
+        return false;
+
+    dir = scanDirectories.getReference (nextScanDirectory++);
+    return true;
+}
+
+//==============================================================================
+bool SyncEngine::merge()
+{
+    AmazonS3::ListOptions options;
+    options.prefix = prefix;
+
+    BucketListing listing (s3, bucket, options);
+    int localIndex = 0;
+
+    // Both sides come in key order, so each is walked once
+    while (listing.next())
+    {
+        const ListBucketParser::Entry& remote = listing.getEntry();
+
+        // Folder markers
+        if (remote.key.endsWithChar ('/'))
+            continue;
+
+        const String key (remote.key.substring (prefix.length()));
+
+        {
+            const ScopedLock sl (lock);
+            ++stats.numRemote;
+        }
+
+        int order = -1;
+
+        while (localIndex < localFiles.size())
+        {
+            const LocalFile& local = localFiles.getReference (localIndex);
+            order = local.key.compare (key);
+
+            if (order >= 0)
+                break;
+
+            onlyLocal (local);
+            ++localIndex;
+        }
+
+        if (order == 0)
+        {
+            const LocalFile& local = localFiles.getReference (localIndex++);
+
+            if (isChanged (local, remote))
+            {
+                addTransfer (key, direction == upload ? local.size : remote.size, &remote);
+            }
+            else
+            {
+                const ScopedLock sl (lock);
+                ++stats.numUnchanged;
+            }
+        }
+        else
+        {
+            onlyRemote (key, remote);
+        }
+    }
+
+    // Without the rest of the listing nothing more can be said to be missing
+    if (listing.failed())
+    {
+        const ScopedLock sl (lock);
+        error = listing.getError();
+        return false;
+    }
+
+    while (localIndex < localFiles.size())
+        onlyLocal (localFiles.getReference (localIndex++));
+
+    return true;
+}
+
+void SyncEngine::onlyLocal (const LocalFile& local)
+{
+    if (direction == upload)
+    {
+        addTransfer (local.key, local.size, nullptr);
+    }
+    else if (deleteExtraneous)
+    {
+        Task task;
+        task.key = local.key;
+        task.file = getLocalFile (local.key);
+        task.size = local.size;
+        task.remove = true;
+        transfers.add (new TransferJob (*this, task));
+    }
+    else
+    {
+        const ScopedLock sl (lock);
+        extraneousKeys.add (prefix + local.key);
+    }
+}
+
+void SyncEngine::onlyRemote (const String& key, const ListBucketParser::Entry& remote)
+{
+    if (direction == download)
+    {
+        addTransfer (key, remote.size, &remote);
+    }
+    else if (remoteDeleter != nullptr)
+    {
+        remoteDeleter->add (prefix + key);
+    }
+    else
+    {
+        const ScopedLock sl (lock);
+        extraneousKeys.add (prefix + key);
+    }
+}
+
+bool SyncEngine::isChanged (const LocalFile& local, const ListBucketParser::Entry& remote)
+{
+    FileHashIndex* const hashIndex = s3.getHashIndex();
+
+    // Untouched since it was last transferred as the object that's still
+    // there.  This comes before the sizes, which for gzipped objects are
+    // of the compressed bytes.
+    if (hashIndex != nullptr && remote.hasETag)
+    {
+        String remoteETag (String::toHexString (remote.etag, sizeof (remote.etag), 0));
+
+        if (remote.etagParts > 0)
+            remoteETag << '-' << remote.etagParts;
+
+        if (hashIndex->getRemoteETag (getLocalFile (local.key)).equalsIgnoreCase (remoteETag))
+            return false;
+    }
+
+    // With compression on, sizes are expected to differ
+    if (local.size != remote.size && ! s3.getCompressUploads())
+        return true;
+
+    // An upload leaves the object newer than the file and a download leaves
+    // the file newer than the object, so only the far side being newer
+    // counts.  Downloads get a second's slack for coarse file system times.
+    const bool newer = direction == upload ? local.modified > remote.lastModified
+                                           : remote.lastModified > local.modified + 1000;
+
+    if (! newer)
+        return false;
+
+    // Touched but maybe not changed, which the hash index can often tell
+    // without reading the file
+    if (hashIndex != nullptr && remote.hasETag && remote.etagParts == 0)
+    {
+        const String md5 (hashIndex->getChecksum (getLocalFile (local.key), Checksum::md5));
+
+        if (md5.equalsIgnoreCase (String::toHexString (remote.etag, sizeof (remote.etag), 0)))
+            return false;
+    }
+
+    return true;
+}
+
+File SyncEngine::getLocalFile (const String& key) const
+{
+    if (File::separator != '/')
+        return directory.getChildFile (key.replaceCharacter ('/', File::separator));
+
+    return directory.getChildFile (key);
+}
+
+//==============================================================================
+void SyncEngine::addTransfer (const String& key, int64 size, const ListBucketParser::Entry* remote)
+{
+    Task task;
+    task.key = key;
+    task.file = getLocalFile (key);
+    task.size = size;
+    task.remove = false;
+
+    if (remote != nullptr)
+        task.remote = *remote;
+
+    // Keys like "a/../../b" would land outside the directory
+    if (direction == download && ! task.file.isAChildOf (directory))
+    {
+        const ScopedLock sl (lock);
+        failedKeys.add (prefix + key);
+        ++stats.numFailed;
+        return;
+    }
+
+    transfers.add (new TransferJob (*this, task));
+}
+
+void SyncEngine::runTask (const Task& task)
+{
+    bool ok = false;
+
+    S3Object object (bucket, prefix + task.key);
+
+    // Remote deletes go through remoteDeleter instead
+    if (task.remove)
+    {
+        ok = task.file.deleteFile();
+    }
+    else
+    {
+        if (direction == upload)
+            ok = s3.putObject (object, task.file);
+        else
+            ok = task.file.getParentDirectory().createDirectory()
+                  && s3.getObject (object, task.file, task.remote);
+    }
+
+    const ScopedLock sl (lock);
+
+    if (! ok)
+    {
+        failedKeys.add (prefix + task.key);
+        ++stats.numFailed;
+    }
+    else if (task.remove)
+    {
+        ++stats.numDeleted;
+    }
+    else
+    {
+        ++stats.numTransferred;
+        stats.bytesTransferred += task.size;
+    }
+}
@@ -0,0 +1,145 @@
+/*
+  ==============================================================================
+
+    SyncEngine.h
+
+  ==============================================================================
+*/
+
+#ifndef __SYNCENGINE_H_0B58E2F4__
+#define __SYNCENGINE_H_0B58E2F4__
+
+#include "AmazonS3.h"
+#include "WorkQueue.h"
+
+class BatchDelete;
+
+
+//==============================================================================
+//==============================================================================
+/** Brings a bucket prefix and a local directory into line, one way.
+
+    The local tree is scanned by several threads at once (one top level
+    directory each), sorted, and merged against the remote listing as it
+    pages in, so both sides are walked once, in key order.  A file counts as
+    changed if its size differs or it's newer than the other side; if there's
+    a hash index, newer files whose MD5 still matches the ETag are left alone.
+
+    Transfers run on their own threads, fed through a short queue so the
+    merge never runs far ahead of them.
+
+    Keys are the prefix (a '/' is added if it doesn't end with one) plus the
+    path relative to the directory, with '/' separators.
+*/
+class SyncEngine
+{
+public:
+    //==============================================================================
+    enum Direction
+    {
+        upload = 0,     // local to bucket
+        download        // bucket to local
+    };
+
+    SyncEngine (AmazonS3& s3, const String& bucket, const String& prefix,
+                const File& directory, Direction direction, int numThreads = 8);
+
+    ~SyncEngine();
+
+    //==============================================================================
+    // Deletes whatever is only on the receiving side, keys for uploads and
+    // local files for downloads.  Otherwise they're just reported, see
+    // getExtraneousKeys().  Keys are deleted in batches, and only if every
+    // local directory could be read.
+    void setDeleteExtraneous (bool shouldDelete)    { deleteExtraneous = shouldDelete; }
+
+    //==============================================================================
+    // True if everything was scanned, listed and transferred.  A directory
+    // that can't be read is reported by getError(), the rest still goes.
+    bool run();
+
+    struct Stats
+    {
+        Stats() : numLocal (0), numRemote (0), numUnchanged (0), numTransferred (0),
+                  numDeleted (0), numFailed (0), bytesTransferred (0) {}
+
+        int numLocal, numRemote;
+        int numUnchanged, numTransferred, numDeleted, numFailed;
+        int64 bytesTransferred;
+    };
+
+    Stats getStats() const;
+    StringArray getFailedKeys() const;
+    StringArray getExtraneousKeys() const;
+    String getError() const;
+
+private:
+    //==============================================================================
+    struct LocalFile
+    {
+        String key;
+        int64 size;
+        int64 modified;     // milliseconds since 1970
+    };
+
+    struct Task
+    {
+        String key;
+        File file;
+        int64 size;
+        bool remove;
+        ListBucketParser::Entry remote;     // for downloads, saves a HEAD
+    };
+
+    class ScanWorker;
+    class TransferJob;
+    class KeyComparator;
+    class DeleteResults;
+    friend class ScanWorker;
+    friend class TransferJob;
+    friend class DeleteResults;
+
+    //==============================================================================
+    AmazonS3& s3;
+    const String bucket;
+    String prefix;
+    const File directory;
+    const Direction direction;
+    const int numThreads;
+    bool deleteExtraneous;
+
+    Array<LocalFile> localFiles;
+    Array<File> scanDirectories;
+    int nextScanDirectory;
+    bool scanComplete;
+
+    WorkQueue transfers;
+    ScopedPointer<BatchDelete> remoteDeleter;
+
+    Stats stats;
+    StringArray failedKeys, extraneousKeys;
+    String error;
+    CriticalSection lock;
+
+    //==============================================================================
+    bool scanLocal();
+    void scanDirectory (const File& dir, bool recursive, Array<LocalFile>& results);
+    bool claimScanDirectory (File& dir);
+    static bool canReadDirectory (const File& dir);
+    void scanFailed (const File& dir);
+
+    bool merge();
+    void onlyLocal (const LocalFile& local);
+    void onlyRemote (const String& key, const ListBucketParser::Entry& remote);
+    bool isChanged (const LocalFile& local, const ListBucketParser::Entry& remote);
+    File getLocalFile (const String& key) const;
+
+    void addTransfer (const String& key, int64 size, const ListBucketParser::Entry* remote);
+    void runTask (const Task& task);
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SyncEngine)
+};
+
+
+#endif  // __SYNCENGINE_H_0B58E2F4__
@@ -0,0 +1,245 @@
+/*
+  ==============================================================================
+
+    TransferBufferPool.cpp
+
+  ==============================================================================
+*/
+
+#include "TransferBufferPool.h"
+
+
+//==============================================================================
+//==============================================================================
+class TransferBufferPool::Shard
+{
+public:
+    Shard() {}
+
+    ~Shard()
+    {
+        for (int c = 0; c < numSizeClasses; ++c)
+            jassert (buffers[c].size() == 0);   // trim() should have freed them
+    }
+
+    void* take (int sizeClass)
+    {
+        const SpinLock::ScopedLockType sl (lock);
+        Array<void*>& list = buffers [sizeClass];
+
+        return list.size() > 0 ? list.remove (list.size() - 1) : nullptr;
+    }
+
+    void add (int sizeClass, void* data)
+    {
+        const SpinLock::ScopedLockType sl (lock);
+        buffers [sizeClass].add (data);
+    }
+
+    // Hands back the lot, for the caller to free outside the lock
+    void takeAll (Array<void*>& data, int64& numBytes)
+    {
+        const SpinLock::ScopedLockType sl (lock);
+
+        for (int c = 0; c < numSizeClasses; ++c)
+        {
+            data.addArray (buffers[c]);
+            numBytes += (int64) buffers[c].size() * ((int64) smallestSize << c);
+            buffers[c].clear();
+        }
+    }
+
+private:
+    Array<void*> buffers [numSizeClasses];
+    SpinLock lock;
+
+    JUCE_DECLARE_NON_COPYABLE (Shard);
+};
+
+
+//==============================================================================
+//==============================================================================
+juce_ImplementSingleton (TransferBufferPool)
+
+TransferBufferPool::TransferBufferPool (int64 maxBytesPooled_, int numShards)
+    : maxBytesPooled (maxBytesPooled_)
+{
+    for (int n = jmax (1, numShards); --n >= 0;)
+        shards.add (new Shard());
+}
+
+TransferBufferPool::~TransferBufferPool()
+{
+    // Anything still borrowed would be given back to a pool that's gone
+    jassert (numInUse.get() == 0);
+
+    trim();
+    clearSingletonInstance();
+}
+
+//==============================================================================
+void* TransferBufferPool::borrow (size_t minimumSize, size_t& size)
+{
+    const int sizeClass = getSizeClass (minimumSize);
+    void* data = nullptr;
+
+    if (sizeClass < 0)
+    {
+        size = minimumSize;
+    }
+    else
+    {
+        size = (size_t) smallestSize << sizeClass;
+
+        // This thread's own shard first, where it last gave one back
+        const int first = shards.indexOf (&getShard());
+
+        for (int n = 0; data == nullptr && n < shards.size(); ++n)
+            data = shards.getUnchecked ((first + n) % shards.size())->take (sizeClass);
+
+        if (data != nullptr)
+            bytesPooled -= (int64) size;
+    }
+
+    if (data == nullptr)
+        data = allocate (size);
+
+    jassert (data != nullptr);
+
+    ++numInUse;
+    bytesInUse += (int64) size;
+    return data;
+}
+
+void TransferBufferPool::giveBack (void* data, size_t size)
+{
+    if (data == nullptr)
+        return;
+
+    --numInUse;
+    bytesInUse -= (int64) size;
+
+    const int sizeClass = getSizeClass (size);
+
+    // Odd sizes are only ever the big ones, which aren't kept
+    if (sizeClass >= 0 && ((size_t) smallestSize << sizeClass) == size
+         && bytesPooled.get() + (int64) size <= maxBytesPooled)
+    {
+        bytesPooled += (int64) size;
+        getShard().add (sizeClass, data);
+    }
+    else
+    {
+        release (data);
+    }
+
+    if (maxBytesInUse.get() > 0)
+        bufferReturned.signal();
+}
+
+void TransferBufferPool::trim()
+{
+    for (int n = 0; n < shards.size(); ++n)
+    {
+        Array<void*> data;
+        int64 numBytes = 0;
+        shards.getUnchecked (n)->takeAll (data, numBytes);
+
+        for (int i = 0; i < data.size(); ++i)
+            release (data.getUnchecked (i));
+
+        bytesPooled -= numBytes;
+    }
+}
+
+//==============================================================================
+void TransferBufferPool::setMaxBytesInUse (int64 newMax)
+{
+    maxBytesInUse = newMax;
+
+    // Anyone waiting may fit under the new limit
+    bufferReturned.signal();
+}
+
+bool TransferBufferPool::waitForRoom (int64 numBytes, int timeOutMilliseconds)
+{
+    const uint32 endTime = Time::getMillisecondCounter() + (uint32) timeOutMilliseconds;
+    bool waited = false;
+
+    for (;;)
+    {
+        const int64 limit = maxBytesInUse.get();
+        const int64 used = bytesInUse.get();
+
+        // One transfer always gets to go, however big
+        if (limit <= 0 || used == 0 || used + numBytes <= limit)
+        {
+            // A return only wakes one waiter, so it's passed on in case
+            // there's room for more
+            if (waited)
+                bufferReturned.signal();
+
+            return true;
+        }
+
+        int timeOut = -1;
+
+        if (timeOutMilliseconds >= 0)
+        {
+            timeOut = (int) (endTime - Time::getMillisecondCounter());
+
+            if (timeOut <= 0 || timeOut > timeOutMilliseconds)
+                return false;
+        }
+
+        bufferReturned.wait (timeOut);
+        waited = true;
+    }
+}
+
+//==============================================================================
+TransferBufferPool::Shard& TransferBufferPool::getShard() const
+{
+    // Thread ids tend to be aligned addresses, so the high bits of the
+    // product are used
+    const uint64 id = (uint64) (pointer_sized_uint) Thread::getCurrentThreadId();
+    const uint32 hash = (uint32) ((id * 0x9e3779b97f4a7c15ULL) >> 32);
+
+    return *shards.getUnchecked ((int) (hash % (uint32) shards.size()));
+}
+
+int TransferBufferPool::getSizeClass (size_t size)
+{
+    if (size > ((size_t) smallestSize << (numSizeClasses - 1)))
+        return -1;
+
+    int sizeClass = 0;
+
+    while (((size_t) smallestSize << sizeClass) < size)
+        ++sizeClass;
+
+    return sizeClass;
+}
+
+//==============================================================================
+// Rounded up to a page boundary, with the pointer that malloc gave kept
+// just before it
+void* TransferBufferPool::allocate (size_t size)
+{
+    const size_t pageSize = (size_t) SystemStats::getPageSize();
+    char* const block = static_cast <char*> (std::malloc (size + pageSize + sizeof (void*)));
+
+    if (block == nullptr)
+        return nullptr;
+
+    char* const aligned = reinterpret_cast <char*> (((pointer_sized_uint) block + sizeof (void*) + pageSize - 1)
+                                                      & ~(pointer_sized_uint) (pageSize - 1));
+
+    reinterpret_cast <void**> (aligned)[-1] = block;
+    return aligned;
+}
+
+void TransferBufferPool::release (void* data)
+{
+    std::free (static_cast <void**> (data)[-1]);
+}
@@ -0,0 +1,130 @@
+/*
+  ==============================================================================
+
+    TransferBufferPool.h
+
+  ==============================================================================
+*/
+
+#ifndef __TRANSFERBUFFERPOOL_H_4A9C1E73__
+#define __TRANSFERBUFFERPOOL_H_4A9C1E73__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+
+//==============================================================================
+//==============================================================================
+/** The process's page-aligned buffers for reading, writing and hashing.
+
+    Sizes are rounded up to a power of two from 64K to 8MB, and a returned
+    buffer is kept for the next request of its size rather than freed.
+    Free buffers are held in shards picked by thread, each behind its own
+    spin lock, so a thread normally gets back the buffer it last returned
+    without touching anyone else's.  Anything bigger than 8MB is allocated
+    as asked and freed when it's returned.
+
+    Borrowing never waits, as a transfer often holds one buffer while it
+    borrows another.  To cap what's in flight, whatever starts transfers
+    calls waitForRoom() before it starts another.
+*/
+class TransferBufferPool
+{
+public:
+    //==============================================================================
+    TransferBufferPool (int64 maxBytesPooled = 64 * 1024 * 1024, int numShards = 8);
+    ~TransferBufferPool();
+
+    juce_DeclareSingleton (TransferBufferPool, false)
+
+    //==============================================================================
+    // At least minimumSize bytes, the size actually given is put in size
+    void* borrow (size_t minimumSize, size_t& size);
+    void giveBack (void* data, size_t size);
+
+    // Frees everything that isn't borrowed
+    void trim();
+
+    //==============================================================================
+    int getNumInUse() const             { return numInUse.get(); }
+    int64 getBytesInUse() const         { return bytesInUse.get(); }
+    int64 getBytesPooled() const        { return bytesPooled.get(); }
+
+    // 0, the default, is no limit
+    void setMaxBytesInUse (int64 newMax);
+    int64 getMaxBytesInUse() const      { return maxBytesInUse.get(); }
+
+    // Returns once numBytes more would fit under the limit, or nothing is
+    // borrowed at all.  False if it timed out first.
+    bool waitForRoom (int64 numBytes, int timeOutMilliseconds = -1);
+
+    //==============================================================================
+    enum
+    {
+        smallestSize = 64 * 1024,
+        numSizeClasses = 8          // up to 8MB
+    };
+
+private:
+    //==============================================================================
+    class Shard;
+
+    OwnedArray<Shard> shards;
+    const int64 maxBytesPooled;
+    Atomic<int> numInUse;
+    Atomic<int64> bytesInUse, bytesPooled, maxBytesInUse;
+    WaitableEvent bufferReturned;
+
+    //==============================================================================
+    Shard& getShard() const;
+    static int getSizeClass (size_t size);
+
+    static void* allocate (size_t size);
+    static void release (void* data);
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TransferBufferPool)
+};
+
+
+//==============================================================================
+//==============================================================================
+/** A buffer borrowed from the TransferBufferPool for as long as it's in scope.
+
+    @code
+    TransferBuffer buffer (1024 * 1024);
+
+    while ((numRead = in.read (buffer, (int) buffer.getSize())) > 0)
+        out.write (buffer, numRead);
+    @endcode
+*/
+class TransferBuffer
+{
+public:
+    //==============================================================================
+    explicit TransferBuffer (size_t minimumSize)
+        : data (static_cast <char*> (TransferBufferPool::getInstance()->borrow (minimumSize, size)))
+    {
+    }
+
+    ~TransferBuffer()
+    {
+        TransferBufferPool::getInstance()->giveBack (data, size);
+    }
+
+    //==============================================================================
+    char* getData() const noexcept          { return data; }
+    operator char*() const noexcept         { return data; }
+
+    // Can be more than was asked for
+    size_t getSize() const noexcept         { return size; }
+
+private:
+    //==============================================================================
+    size_t size;
+    char* const data;
+
+    JUCE_DECLARE_NON_COPYABLE (TransferBuffer);
+};
+
+
+#endif  // __TRANSFERBUFFERPOOL_H_4A9C1E73__
@@ -0,0 +1,376 @@
+/*
+  ==============================================================================
+
+    TransferScheduler.cpp
+
+  ==============================================================================
+*/
+
+#include "TransferScheduler.h"
+
+
+//==============================================================================
+//==============================================================================
+TransferScheduler::Upload::Upload (AmazonS3& s3_, const String& bucket_, const String& key_,
+                                   const File& file_, Priority priority_)
+    : Transfer (priority_, file_.getSize()),
+      s3 (s3_),
+      bucket (bucket_),
+      key (key_),
+      file (file_)
+{
+}
+
+bool TransferScheduler::Upload::perform()
+{
+    S3Object object (bucket, key);
+    return s3.putObject (object, file);
+}
+
+//==============================================================================
+TransferScheduler::Download::Download (AmazonS3& s3_, const String& bucket_, const String& key_,
+                                       const File& file_, int64 size_, Priority priority_)
+    : Transfer (priority_, size_),
+      s3 (s3_),
+      bucket (bucket_),
+      key (key_),
+      file (file_)
+{
+}
+
+bool TransferScheduler::Download::perform()
+{
+    S3Object object (bucket, key);
+    return s3.getObject (object, file);
+}
+
+
+//==============================================================================
+//==============================================================================
+class TransferScheduler::Worker  : public Thread
+{
+public:
+    Worker (TransferScheduler& owner_, bool smallOnly_)
+        : Thread ("S3 transfer"), owner (owner_), smallOnly (smallOnly_) {}
+
+    ~Worker()
+    {
+        for (int p = 0; p < numPriorities; ++p)
+            for (int i = queues[p].size(); --i >= 0;)
+                delete queues[p].getUnchecked (i);
+    }
+
+    void run()
+    {
+        while (! threadShouldExit())
+        {
+            Transfer* transfer = owner.findWork (*this);
+
+            if (transfer == nullptr)
+            {
+                // Marked idle before looking once more, so anything added
+                // in between is either seen here or wakes this thread
+                idle = 1;
+                transfer = owner.findWork (*this);
+
+                if (transfer == nullptr)
+                {
+                    wait (-1);
+                    idle = 0;
+                    continue;
+                }
+
+                // Woken for a different transfer than this one, so that
+                // one still needs a thread
+                if (! claimIfIdle())
+                    owner.passOnWakeup();
+            }
+
+            owner.transferDone (transfer, transfer->perform());
+        }
+    }
+
+    // Only one caller gets true for each time the thread goes idle
+    bool claimIfIdle()
+    {
+        return idle.compareAndSetBool (0, 1);
+    }
+
+    //==============================================================================
+    void push (Transfer* transfer)
+    {
+        const SpinLock::ScopedLockType sl (lock);
+        Array<Transfer*>& queue = queues [transfer->getPriority()];
+
+        if (transfer->getPriority() != bulk)
+        {
+            queue.add (transfer);
+            return;
+        }
+
+        // Largest first, and first come first served among equals, so it
+        // goes after the last one that's at least as big
+        int start = 0, end = queue.size();
+
+        while (start < end)
+        {
+            const int mid = (start + end) / 2;
+
+            if (queue.getUnchecked (mid)->getSize() >= transfer->getSize())
+                start = mid + 1;
+            else
+                end = mid;
+        }
+
+        queue.insert (start, transfer);
+    }
+
+    // The owner takes from the front, others from the back, except in bulk
+    // where everyone wants the largest.  A thread that only runs small
+    // transfers only takes from the others kept for them.
+    Transfer* take (int priority, bool stealing, bool smallOnlyTaker)
+    {
+        const SpinLock::ScopedLockType sl (lock);
+        const int index = find (priority, stealing, smallOnlyTaker);
+
+        return index >= 0 ? queues [priority].remove (index) : nullptr;
+    }
+
+    // The size of what take() would return, -1 if nothing
+    int64 peekSize (int priority, bool stealing, bool smallOnlyTaker)
+    {
+        const SpinLock::ScopedLockType sl (lock);
+        const int index = find (priority, stealing, smallOnlyTaker);
+        return index >= 0 ? queues [priority].getUnchecked (index)->getSize() : -1;
+    }
+
+    bool isSmallOnly() const    { return smallOnly; }
+
+private:
+    TransferScheduler& owner;
+    const bool smallOnly;
+    Array<Transfer*> queues [numPriorities];
+    SpinLock lock;      // held for one lookup and one insert or removal
+    Atomic<int> idle;
+
+    // The index take() would remove, -1 if nothing.  Small transfers are
+    // only ever dealt to the threads kept for them, whose queues hold
+    // nothing else, so a small-only taker never has to search.
+    int find (int priority, bool stealing, bool smallOnlyTaker) const
+    {
+        const Array<Transfer*>& queue = queues [priority];
+
+        if (queue.size() == 0 || (smallOnlyTaker && ! smallOnly))
+            return -1;
+
+        const int index = (stealing && priority != bulk) ? queue.size() - 1 : 0;
+        jassert (! smallOnlyTaker || queue.getUnchecked (index)->getSize() <= owner.smallTransferSize);
+
+        return index;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (Worker);
+};
+
+
+//==============================================================================
+namespace
+{
+    struct LargestFirst
+    {
+        static int compareElements (TransferScheduler::Transfer* first, TransferScheduler::Transfer* second)
+        {
+            return first->getSize() > second->getSize() ? -1
+                                                        : (first->getSize() < second->getSize() ? 1 : 0);
+        }
+    };
+}
+
+
+//==============================================================================
+//==============================================================================
+TransferScheduler::TransferScheduler (int numThreads, int64 smallTransferSize_, int numSmallThreads)
+    : smallTransferSize (smallTransferSize_),
+      numSmallWorkers (0),
+      listener (nullptr)
+{
+    numThreads = jmax (1, numThreads);
+
+    if (numSmallThreads < 0)
+        numSmallThreads = numThreads / 4;
+
+    // At least one thread has to be free to take anything
+    numSmallWorkers = jlimit (0, numThreads - 1, numSmallThreads);
+
+    // The small-only ones come first
+    for (int n = 0; n < numThreads; ++n)
+        workers.add (new Worker (*this, n < numSmallWorkers));
+
+    for (int n = 0; n < workers.size(); ++n)
+        workers.getUnchecked (n)->startThread();
+}
+
+TransferScheduler::~TransferScheduler()
+{
+    waitForAll();
+
+    for (int n = 0; n < workers.size(); ++n)
+    {
+        workers.getUnchecked (n)->signalThreadShouldExit();
+        workers.getUnchecked (n)->notify();
+    }
+
+    for (int n = 0; n < workers.size(); ++n)
+        workers.getUnchecked (n)->waitForThreadToExit (-1);
+}
+
+//==============================================================================
+void TransferScheduler::addTransfer (Transfer* transfer)
+{
+    Array<Transfer*> transfers;
+    transfers.add (transfer);
+    addTransfers (transfers);
+}
+
+void TransferScheduler::addTransfers (const Array<Transfer*>& transfers)
+{
+    // Dealt out biggest first, so every thread gets its share of the big ones
+    Array<Transfer*> sorted (transfers);
+    LargestFirst comparator;
+    sorted.sort (comparator, true);
+
+    numPending += sorted.size();
+
+    // Small ones are shared round the threads kept for them, the rest
+    // round the others
+    for (int i = 0; i < sorted.size(); ++i)
+    {
+        Transfer* const transfer = sorted.getUnchecked (i);
+        jassert (transfer != nullptr);
+
+        const bool isSmall = transfer->getSize() <= smallTransferSize;
+
+        if (isSmall && numSmallWorkers > 0)
+            workers.getUnchecked ((int) ((uint32) ++nextSmallWorker % (uint32) numSmallWorkers))->push (transfer);
+        else
+            workers.getUnchecked (numSmallWorkers + (int) ((uint32) ++nextWorker % (uint32) (workers.size() - numSmallWorkers)))->push (transfer);
+
+        wakeIdleWorker (isSmall);
+    }
+}
+
+bool TransferScheduler::waitForAll()
+{
+    // The event can be left over from an earlier batch, the count decides
+    while (numPending.get() != 0)
+        allDone.wait (-1);
+
+    // Passed on for anyone else waiting
+    allDone.signal();
+    return getNumFailed() == 0;
+}
+
+int TransferScheduler::getNumPending() const
+{
+    return numPending.get();
+}
+
+int TransferScheduler::getNumFailed() const
+{
+    return numFailed.get();
+}
+
+//==============================================================================
+TransferScheduler::Transfer* TransferScheduler::findWork (Worker& worker)
+{
+    const int self = workers.indexOf (&worker);
+
+    for (int p = 0; p < numPriorities; ++p)
+    {
+        Transfer* transfer = nullptr;
+
+        // Bulk goes largest first across all the queues, not just this one
+        if (p == bulk)
+        {
+            Worker* largest = nullptr;
+            int64 largestSize = -1;
+
+            for (int n = 0; n < workers.size(); ++n)
+            {
+                Worker* const other = workers.getUnchecked (n);
+                const int64 size = other->peekSize (p, other != &worker, worker.isSmallOnly());
+
+                if (size > largestSize)
+                {
+                    largest = other;
+                    largestSize = size;
+                }
+            }
+
+            if (largest != nullptr)
+                transfer = largest->take (p, largest != &worker, worker.isSmallOnly());
+        }
+
+        if (transfer == nullptr)
+            transfer = worker.take (p, false, worker.isSmallOnly());
+
+        for (int n = 1; transfer == nullptr && n < workers.size(); ++n)
+            transfer = workers.getUnchecked ((self + n) % workers.size())->take (p, true, worker.isSmallOnly());
+
+        if (transfer != nullptr)
+            return transfer;
+    }
+
+    return nullptr;
+}
+
+void TransferScheduler::transferDone (Transfer* transfer, bool succeeded)
+{
+    if (listener != nullptr)
+    {
+        const ScopedLock sl (listenerLock);
+        listener->transferFinished (*transfer, succeeded);
+    }
+
+    delete transfer;
+
+    if (! succeeded)
+        ++numFailed;
+
+    if (--numPending == 0)
+        allDone.signal();
+}
+
+void TransferScheduler::wakeIdleWorker (bool isSmall)
+{
+    // One thread per transfer, rather than all of them to fight over it.
+    // If none are idle, whichever finishes first will find it.
+    if (isSmall)
+        wakeIdleWorker (0, workers.size());
+    else
+        wakeIdleWorker (numSmallWorkers, workers.size());
+}
+
+void TransferScheduler::passOnWakeup()
+{
+    // What's waiting could be big, so a thread that can take anything goes
+    // first, and a small-only one only if that's all there is
+    if (! wakeIdleWorker (numSmallWorkers, workers.size()))
+        wakeIdleWorker (0, numSmallWorkers);
+}
+
+bool TransferScheduler::wakeIdleWorker (int start, int end)
+{
+    for (int n = start; n < end; ++n)
+    {
+        Worker* const worker = workers.getUnchecked (n);
+
+        if (worker->claimIfIdle())
+        {
+            worker->notify();
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,176 @@
+/*
+  ==============================================================================
+
+    TransferScheduler.h
+
+  ==============================================================================
+*/
+
+#ifndef __TRANSFERSCHEDULER_H_8D14F7A0__
+#define __TRANSFERSCHEDULER_H_8D14F7A0__
+
+#include "AmazonS3.h"
+
+
+//==============================================================================
+//==============================================================================
+/** Runs transfers on a fixed set of threads, most urgent first.
+
+    Each thread has its own queue for each priority, transfers are dealt
+    out across them as they're added, and a thread with nothing of its own
+    to do takes from the far end of another's.  A thread always looks for
+    interactive work (its own, then anyone's) before normal, and normal
+    before bulk.  Bulk work is taken largest first across all the queues,
+    so the long transfers of a batch start early rather than finishing it
+    on their own.
+
+    A few threads only ever take transfers up to smallTransferSize, so
+    however many big ones are queued small ones still go straight through.
+
+    Adding a transfer takes no lock but the target queue's spin lock, and
+    wakes at most one idle thread, which never polls, so a short request
+    is started as soon as a thread is free for it.
+
+    @code
+    TransferScheduler scheduler;
+
+    Array<TransferScheduler::Transfer*> batch;
+
+    for (int i = 0; i < files.size(); ++i)
+        batch.add (new TransferScheduler::Upload (s3, "bucket", keys[i], files[i],
+                                                  TransferScheduler::bulk));
+
+    scheduler.addTransfers (batch);
+    scheduler.waitForAll();
+    @endcode
+*/
+class TransferScheduler
+{
+public:
+    //==============================================================================
+    enum Priority
+    {
+        interactive = 0,
+        normal,
+        bulk,
+        numPriorities
+    };
+
+    //==============================================================================
+    class Transfer
+    {
+    public:
+        Transfer (Priority priority_, int64 size_) : priority (priority_), size (size_) {}
+        virtual ~Transfer() {}
+
+        // Called on one of the scheduler's threads
+        virtual bool perform() = 0;
+
+        Priority getPriority() const    { return priority; }
+        int64 getSize() const           { return size; }
+
+    private:
+        const Priority priority;
+        const int64 size;
+
+        JUCE_DECLARE_NON_COPYABLE (Transfer);
+    };
+
+    // Puts a file, sized from the file
+    class Upload  : public Transfer
+    {
+    public:
+        Upload (AmazonS3& s3, const String& bucket, const String& key,
+                const File& file, Priority priority = normal);
+
+        bool perform();
+
+    private:
+        AmazonS3& s3;
+        const String bucket, key;
+        const File file;
+    };
+
+    // Gets an object into a file, the size being whatever the listing said
+    class Download  : public Transfer
+    {
+    public:
+        Download (AmazonS3& s3, const String& bucket, const String& key,
+                  const File& file, int64 size, Priority priority = normal);
+
+        bool perform();
+
+    private:
+        AmazonS3& s3;
+        const String bucket, key;
+        const File file;
+    };
+
+    //==============================================================================
+    class Listener
+    {
+    public:
+        virtual ~Listener() {}
+
+        // Called from the scheduler's threads, but never two at once, just
+        // before the transfer is deleted
+        virtual void transferFinished (Transfer& transfer, bool succeeded) = 0;
+    };
+
+    //==============================================================================
+    // A numSmallThreads of -1 keeps a quarter of the threads for small
+    // transfers
+    TransferScheduler (int numThreads = 8,
+                       int64 smallTransferSize = 1024 * 1024,
+                       int numSmallThreads = -1);
+
+    // Waits for everything that's been added
+    ~TransferScheduler();
+
+    //==============================================================================
+    // Optional, not owned.  Set it before adding anything.
+    void setListener (Listener* newListener)    { listener = newListener; }
+
+    // Takes ownership
+    void addTransfer (Transfer* transfer);
+
+    // Adds a batch in one go, before any of it starts, so a bulk batch runs
+    // largest first as a whole rather than in the order it was added
+    void addTransfers (const Array<Transfer*>& transfers);
+
+    // Returns once everything added so far has finished, true if nothing
+    // has failed yet
+    bool waitForAll();
+
+    int getNumPending() const;
+    int getNumFailed() const;
+
+private:
+    //==============================================================================
+    class Worker;
+    friend class Worker;
+
+    //==============================================================================
+    const int64 smallTransferSize;
+    OwnedArray<Worker> workers;
+    int numSmallWorkers;
+    Atomic<int> nextWorker, nextSmallWorker;
+
+    Listener* listener;
+    Atomic<int> numPending, numFailed;
+    WaitableEvent allDone;
+    CriticalSection listenerLock;
+
+    //==============================================================================
+    Transfer* findWork (Worker& worker);
+    void transferDone (Transfer* transfer, bool succeeded);
+    void wakeIdleWorker (bool isSmall);
+    void passOnWakeup();
+    bool wakeIdleWorker (int start, int end);
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TransferScheduler)
+};
+
+
+#endif  // __TRANSFERSCHEDULER_H_8D14F7A0__
@@ -0,0 +1,164 @@
+/*
+  ==============================================================================
+
+    UploadJournal.cpp
+
+  ==============================================================================
+*/
+
+#include "UploadJournal.h"
+
+
+//==============================================================================
+//==============================================================================
+namespace
+{
+    const char* const journalMagic = "S3 upload journal 1";
+
+    bool isValidPartETag (const String& etag)
+    {
+        return etag.length() == 32 && etag.containsOnly ("0123456789abcdefABCDEF");
+    }
+}
+
+//==============================================================================
+//==============================================================================
+UploadJournal::UploadJournal (const File& journalFile_)
+    : journalFile (journalFile_),
+      sourceSize (0),
+      sourceModified (0),
+      partSize (0)
+{
+    load();
+}
+
+UploadJournal::~UploadJournal()
+{
+}
+
+//==============================================================================
+bool UploadJournal::matches (const String& bucket_, const String& key_, const File& source,
+                             const String& checksumAlgorithm_) const
+{
+    return uploadId.isNotEmpty() && partSize > 0
+            && bucket == bucket_ && key == key_
+            && checksumAlgorithm == checksumAlgorithm_
+            && sourcePath == source.getFullPathName()
+            && sourceSize == source.getSize()
+            && sourceModified == source.getLastModificationTime().toMilliseconds();
+}
+
+bool UploadJournal::start (const String& bucket_, const String& key_, const File& source,
+                           int64 partSize_, const String& uploadId_, const String& checksumAlgorithm_)
+{
+    bucket = bucket_;
+    key = key_;
+    uploadId = uploadId_;
+    checksumAlgorithm = checksumAlgorithm_;
+    sourcePath = source.getFullPathName();
+    sourceSize = source.getSize();
+    sourceModified = source.getLastModificationTime().toMilliseconds();
+    partSize = partSize_;
+    partETags.clear();
+
+    // Everything is one line per value, so none of them can hold a newline
+    if ((bucket + key + uploadId + checksumAlgorithm + sourcePath).containsAnyOf ("\r\n"))
+        return false;
+
+    String text;
+    text << journalMagic << '\n'
+         << "bucket\t" << bucket << '\n'
+         << "key\t" << key << '\n'
+         << "upload\t" << uploadId << '\n'
+         << "checksum\t" << checksumAlgorithm << '\n'
+         << "part-size\t" << String (partSize) << '\n'
+         << "source-size\t" << String (sourceSize) << '\n'
+         << "source-modified\t" << String (sourceModified) << '\n'
+         << "source\t" << sourcePath << '\n';
+
+    TemporaryFile temp (journalFile);
+
+    return temp.getFile().replaceWithText (text)
+            && temp.overwriteTargetFileWithTemporary();
+}
+
+void UploadJournal::remove()
+{
+    journalFile.deleteFile();
+
+    uploadId = String::empty;
+    partETags.clear();
+}
+
+//==============================================================================
+String UploadJournal::getPartETag (int partNumber) const
+{
+    return partETags [partNumber - 1];
+}
+
+bool UploadJournal::setPartETag (int partNumber, const String& etag)
+{
+    if (partNumber < 1 || ! isValidPartETag (etag))
+        return false;
+
+    while (partETags.size() < partNumber)
+        partETags.add (String::empty);
+
+    partETags.set (partNumber - 1, etag.toLowerCase());
+
+    // Appended and flushed as soon as the part is done
+    FileOutputStream out (journalFile);
+
+    if (! out.openedOk())
+        return false;
+
+    out.writeText ("part\t" + String (partNumber) + "\t" + etag.toLowerCase() + "\n", false, false);
+    out.flush();
+
+    return out.getStatus().wasOk();
+}
+
+//==============================================================================
+void UploadJournal::load()
+{
+    StringArray lines;
+    lines.addLines (journalFile.loadFileAsString());
+
+    if (lines [0] != journalMagic)
+        return;
+
+    for (int i = 1; i < lines.size(); ++i)
+    {
+        const String& line = lines[i];
+        const int tab = line.indexOfChar ('\t');
+
+        if (tab <= 0)
+            continue;
+
+        const String name (line.substring (0, tab));
+        const String value (line.substring (tab + 1));
+
+        if (name == "part")
+        {
+            // A crash part way through writing leaves a line that won't parse
+            const int partNumber = value.upToFirstOccurrenceOf ("\t", false, false).getIntValue();
+            const String etag (value.fromFirstOccurrenceOf ("\t", false, false));
+
+            if (partNumber > 0 && isValidPartETag (etag))
+            {
+                while (partETags.size() < partNumber)
+                    partETags.add (String::empty);
+
+                partETags.set (partNumber - 1, etag);
+            }
+        }
+        else if (name == "bucket")           bucket = value;
+        else if (name == "key")              key = value;
+        else if (name == "upload")           uploadId = value;
+        else if (name == "checksum")         checksumAlgorithm = value;
+        else if (name == "part-size")        partSize = value.getLargeIntValue();
+        else if (name == "source-size")      sourceSize = value.getLargeIntValue();
+        else if (name == "source-modified")  sourceModified = value.getLargeIntValue();
+        else if (name == "source")           sourcePath = value;
+    }
+}
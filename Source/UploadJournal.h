@@ -0,0 +1,80 @@
+/*
+  ==============================================================================
+
+    UploadJournal.h
+
+  ==============================================================================
+*/
+
+#ifndef __UPLOADJOURNAL_H_4F1D6A93__
+#define __UPLOADJOURNAL_H_4F1D6A93__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+
+//==============================================================================
+//==============================================================================
+/** What's been done so far of one multipart upload, kept in a small file.
+
+    The header (bucket, key, upload id, checksum algorithm, part size, and
+    the size and date of the source file) is written once when the upload starts, replacing the
+    old file in one go.  Each finished part is then appended as a line of
+    its own, so a crash can lose at most the part that was in flight, and a
+    torn last line is simply ignored when it's read back.
+
+    See AmazonS3::putObjectMultipart.
+*/
+class UploadJournal
+{
+public:
+    //==============================================================================
+    // Reads back whatever the file holds, if it exists
+    explicit UploadJournal (const File& journalFile);
+    ~UploadJournal();
+
+    //==============================================================================
+    // True if it holds an upload of this file to this key, with parts
+    // checked by the same algorithm (empty for none but their MD5s), and
+    // the file hasn't been changed since
+    bool matches (const String& bucket, const String& key, const File& source,
+                  const String& checksumAlgorithm) const;
+
+    // Throws away any parts and writes a new header
+    bool start (const String& bucket, const String& key, const File& source,
+                int64 partSize, const String& uploadId, const String& checksumAlgorithm);
+
+    // Deletes the file once the upload is complete or abandoned
+    void remove();
+
+    //==============================================================================
+    const String& getBucket() const     { return bucket; }
+    const String& getKey() const        { return key; }
+    const String& getUploadId() const   { return uploadId; }
+    int64 getPartSize() const           { return partSize; }
+
+    // The ETag (hex MD5) of a finished part, empty if it isn't done
+    String getPartETag (int partNumber) const;
+
+    // Records a finished part, appending it to the file straight away
+    bool setPartETag (int partNumber, const String& etag);
+
+private:
+    //==============================================================================
+    const File journalFile;
+
+    String bucket, key, uploadId;
+    String checksumAlgorithm;
+    String sourcePath;
+    int64 sourceSize, sourceModified;
+    int64 partSize;
+    StringArray partETags;      // by part number - 1
+
+    //==============================================================================
+    void load();
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (UploadJournal)
+};
+
+
+#endif  // __UPLOADJOURNAL_H_4F1D6A93__
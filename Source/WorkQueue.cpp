@@ -0,0 +1,130 @@
+/*
+  ==============================================================================
+
+    WorkQueue.cpp
+
+  ==============================================================================
+*/
+
+#include "WorkQueue.h"
+
+
+//==============================================================================
+//==============================================================================
+class WorkQueue::Worker  : public Thread
+{
+public:
+    Worker (WorkQueue& owner_)
+        : Thread (owner_.threadName), owner (owner_) {}
+
+    void run()
+    {
+        while (! threadShouldExit())
+        {
+            bool allDone = false;
+            ScopedPointer<Job> job (owner.takeJob (allDone));
+
+            if (job != nullptr)
+                job->run();
+            else if (allDone)
+                return;
+            else
+                wait (-1);  // woken when a job is added
+        }
+    }
+
+private:
+    WorkQueue& owner;
+
+    JUCE_DECLARE_NON_COPYABLE (Worker);
+};
+
+
+//==============================================================================
+//==============================================================================
+WorkQueue::WorkQueue (const String& threadName_, int numThreads_, int maxQueued_)
+    : threadName (threadName_),
+      numThreads (jmax (1, numThreads_)),
+      maxQueued (maxQueued_ > 0 ? maxQueued_ : 2 * jmax (1, numThreads_)),
+      finished (false)
+{
+}
+
+WorkQueue::~WorkQueue()
+{
+    finish();
+}
+
+//==============================================================================
+void WorkQueue::add (Job* job)
+{
+    jassert (job != nullptr);
+
+    if (workers.size() == 0)
+    {
+        finished = false;
+
+        for (int n = 0; n < numThreads; ++n)
+        {
+            Worker* const worker = new Worker (*this);
+            workers.add (worker);
+            worker->startThread();
+        }
+    }
+
+    for (;;)
+    {
+        {
+            const ScopedLock sl (lock);
+
+            if (jobs.size() < maxQueued)
+            {
+                jobs.add (job);
+                break;
+            }
+        }
+
+        spaceAvailable.wait (-1);
+    }
+
+    for (int n = 0; n < workers.size(); ++n)
+        workers.getUnchecked (n)->notify();
+}
+
+void WorkQueue::finish()
+{
+    {
+        const ScopedLock sl (lock);
+        finished = true;
+    }
+
+    // Workers empty the queue before they see the flag
+    for (int n = 0; n < workers.size(); ++n)
+        workers.getUnchecked (n)->notify();
+
+    for (int n = 0; n < workers.size(); ++n)
+        workers.getUnchecked (n)->waitForThreadToExit (-1);
+
+    workers.clear();
+}
+
+//==============================================================================
+WorkQueue::Job* WorkQueue::takeJob (bool& allDone)
+{
+    Job* job;
+
+    {
+        const ScopedLock sl (lock);
+
+        if (jobs.size() == 0)
+        {
+            allDone = finished;
+            return nullptr;
+        }
+
+        job = jobs.removeAndReturn (0);
+    }
+
+    spaceAvailable.signal();
+    return job;
+}
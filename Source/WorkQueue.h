@@ -0,0 +1,93 @@
+/*
+  ==============================================================================
+
+    WorkQueue.h
+
+  ==============================================================================
+*/
+
+#ifndef __WORKQUEUE_H_5B8E2D17__
+#define __WORKQUEUE_H_5B8E2D17__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+
+//==============================================================================
+//==============================================================================
+/** Jobs run in the order they're added, on a few threads of their own.
+
+    Only a few jobs are allowed to wait, add() blocks while the threads
+    catch up, so whatever feeds it can't get far ahead of them however much
+    work there is.  The threads start with the first job and stop at
+    finish(), which waits for everything queued; adding more after that
+    starts them again.
+
+    add() and finish() are meant to be called from one thread, the one
+    producing the work.
+
+    @code
+    WorkQueue queue ("Uploader", 4);
+
+    for (int i = 0; i < files.size(); ++i)
+        queue.add (new UploadJob (files[i]));
+
+    queue.finish();
+    @endcode
+*/
+class WorkQueue
+{
+public:
+    //==============================================================================
+    class Job
+    {
+    public:
+        Job() {}
+        virtual ~Job() {}
+
+        // Called on one of the queue's threads, the job is deleted after
+        virtual void run() = 0;
+
+    private:
+        JUCE_DECLARE_NON_COPYABLE (Job);
+    };
+
+    //==============================================================================
+    // A maxQueued of 0 lets two jobs per thread wait
+    WorkQueue (const String& threadName, int numThreads, int maxQueued = 0);
+
+    // Waits for anything still queued
+    ~WorkQueue();
+
+    //==============================================================================
+    // Takes ownership, waiting first if the queue is full
+    void add (Job* job);
+
+    // Returns once every job added has run
+    void finish();
+
+    int getNumThreads() const       { return numThreads; }
+
+private:
+    //==============================================================================
+    class Worker;
+    friend class Worker;
+
+    //==============================================================================
+    const String threadName;
+    const int numThreads, maxQueued;
+
+    OwnedArray<Job> jobs;
+    OwnedArray<Worker> workers;
+    bool finished;
+    WaitableEvent spaceAvailable;
+    CriticalSection lock;
+
+    //==============================================================================
+    Job* takeJob (bool& allDone);
+
+    //==============================================================================
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (WorkQueue)
+};
+
+
+#endif  // __WORKQUEUE_H_5B8E2D17__